@@ -0,0 +1,576 @@
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "stb_image.h"
+#include "BlockCompression.h"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BLOCK_COMPRESSION_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+size_t BlockBytes(BlockFormat format)
+{
+	switch (format)
+	{
+	case BLOCK_FORMAT_BC1:
+		return 8;
+	case BLOCK_FORMAT_BC3:
+	case BLOCK_FORMAT_BC5:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+size_t CompressedSize(BlockFormat format, int width, int height)
+{
+	return (size_t)((width + 3) / 4) * ((height + 3) / 4) * BlockBytes(format);
+}
+
+//a texel of 1 to 4 channels as rgba
+static void ExpandTexel(const unsigned char* texel, int components, unsigned char* out)
+{
+	switch (components)
+	{
+	case 1:
+		out[0] = out[1] = out[2] = texel[0];
+		out[3] = 255;
+		break;
+	case 2:
+		out[0] = out[1] = out[2] = texel[0];
+		out[3] = texel[1];
+		break;
+	case 3:
+		out[0] = texel[0];
+		out[1] = texel[1];
+		out[2] = texel[2];
+		out[3] = 255;
+		break;
+	default:
+		memcpy(out, texel, 4);
+		break;
+	}
+}
+
+//the 4x4 block at (bx, by) as 16 rgba texels; blocks past the right/bottom edges repeat the last column/row
+static void FetchBlock(const unsigned char* pixels, int width, int height, int components, int bx, int by, unsigned char block[64])
+{
+	for (int y = 0; y < 4; y++)
+	{
+		const unsigned char* row = pixels + (size_t)min(4 * by + y, height - 1) * width * components;
+		for (int x = 0; x < 4; x++)
+			ExpandTexel(row + min(4 * bx + x, width - 1) * components, components, block + 4 * (4 * y + x));
+	}
+}
+
+static uint16_t PackColor565(const float color[3])
+{
+	int r = (int)(min(max(color[0], 0.0f), 255.0f) * (31.0f / 255.0f) + 0.5f);
+	int g = (int)(min(max(color[1], 0.0f), 255.0f) * (63.0f / 255.0f) + 0.5f);
+	int b = (int)(min(max(color[2], 0.0f), 255.0f) * (31.0f / 255.0f) + 0.5f);
+	return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+//565 -> 8 bits per channel, replicating the high bits as the gpu does
+static void UnpackColor565(uint16_t color, int out[3])
+{
+	int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+	out[0] = (r << 3) | (r >> 2);
+	out[1] = (g << 2) | (g >> 4);
+	out[2] = (b << 3) | (b >> 2);
+}
+
+//index of the nearest of the 4 palette colors for every texel. Returns the summed squared error
+static float SelectColorIndices(const float* r, const float* g, const float* b, const float palette[4][3], unsigned char indices[16])
+{
+#ifdef BLOCK_COMPRESSION_SSE
+	__m128 total = _mm_setzero_ps();
+	for (int i = 0; i < 16; i += 4)
+	{
+		__m128 texelR = _mm_loadu_ps(r + i);
+		__m128 texelG = _mm_loadu_ps(g + i);
+		__m128 texelB = _mm_loadu_ps(b + i);
+		__m128 best = _mm_set1_ps(FLT_MAX);
+		__m128i bestIndex = _mm_setzero_si128();
+		for (int k = 0; k < 4; k++)
+		{
+			__m128 dr = _mm_sub_ps(texelR, _mm_set1_ps(palette[k][0]));
+			__m128 dg = _mm_sub_ps(texelG, _mm_set1_ps(palette[k][1]));
+			__m128 db = _mm_sub_ps(texelB, _mm_set1_ps(palette[k][2]));
+			__m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db));
+			__m128i closer = _mm_castps_si128(_mm_cmplt_ps(d, best));
+			best = _mm_min_ps(d, best);
+			bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(k)));
+		}
+		total = _mm_add_ps(total, best);
+
+		int32_t lanes[4];
+		_mm_storeu_si128((__m128i*)lanes, bestIndex);
+		for (int j = 0; j < 4; j++)
+			indices[i + j] = (unsigned char)lanes[j];
+	}
+	float sums[4];
+	_mm_storeu_ps(sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3];
+#else
+	float total = 0.0f;
+	for (int i = 0; i < 16; i++)
+	{
+		float best = FLT_MAX;
+		int bestIndex = 0;
+		for (int k = 0; k < 4; k++)
+		{
+			float dr = r[i] - palette[k][0], dg = g[i] - palette[k][1], db = b[i] - palette[k][2];
+			float d = dr * dr + dg * dg + db * db;
+			if (d < best)
+			{
+				best = d;
+				bestIndex = k;
+			}
+		}
+		total += best;
+		indices[i] = (unsigned char)bestIndex;
+	}
+	return total;
+#endif
+}
+
+//quantizes the endpoints to 565, picks the indices and writes the 8 byte BC1 block. Returns the squared error
+static float EncodeColorEndpoints(const float* r, const float* g, const float* b, const float e0[3], const float e1[3],
+	unsigned char* out, unsigned char indices[16])
+{
+	//the 4 color mode needs c0 > c1
+	uint16_t c0 = PackColor565(e0), c1 = PackColor565(e1);
+	if (c0 < c1)
+		swap(c0, c1);
+
+	int endpoints[2][3];
+	UnpackColor565(c0, endpoints[0]);
+	UnpackColor565(c1, endpoints[1]);
+	float palette[4][3];
+	for (int i = 0; i < 3; i++)
+	{
+		palette[0][i] = (float)endpoints[0][i];
+		palette[1][i] = (float)endpoints[1][i];
+		palette[2][i] = (2.0f * endpoints[0][i] + endpoints[1][i]) / 3.0f;
+		palette[3][i] = (endpoints[0][i] + 2.0f * endpoints[1][i]) / 3.0f;
+	}
+	if (c0 == c1)
+	{
+		//equal endpoints decode in the 3 color mode, where index 3 is black: a solid block, index 0 everywhere
+		memcpy(palette[2], palette[0], sizeof(palette[0]));
+		memcpy(palette[3], palette[0], sizeof(palette[0]));
+	}
+	float error = SelectColorIndices(r, g, b, palette, indices);
+
+	uint32_t bits = 0;
+	for (int i = 0; i < 16; i++)
+		bits |= (uint32_t)indices[i] << (2 * i);
+	out[0] = (unsigned char)(c0 & 0xFF);
+	out[1] = (unsigned char)(c0 >> 8);
+	out[2] = (unsigned char)(c1 & 0xFF);
+	out[3] = (unsigned char)(c1 >> 8);
+	for (int i = 0; i < 4; i++)
+		out[4 + i] = (unsigned char)(bits >> (8 * i));
+	return error;
+}
+
+//BC1 block of 16 rgba texels (alpha ignored). The endpoints start at the extremes of the texels projected on the
+//principal axis of their colors and are then refined by least squares with the indices fixed, while that lowers the error
+static void EncodeColorBlock(const unsigned char block[64], unsigned char* out)
+{
+	float r[16], g[16], b[16];
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		r[i] = block[4 * i];
+		g[i] = block[4 * i + 1];
+		b[i] = block[4 * i + 2];
+		mean[0] += r[i];
+		mean[1] += g[i];
+		mean[2] += b[i];
+	}
+	for (float& m : mean)
+		m /= 16.0f;
+
+	//covariance: rr, rg, rb, gg, gb, bb
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+	for (int i = 0; i < 16; i++)
+	{
+		float dr = r[i] - mean[0], dg = g[i] - mean[1], db = b[i] - mean[2];
+		cov[0] += dr * dr;
+		cov[1] += dr * dg;
+		cov[2] += dr * db;
+		cov[3] += dg * dg;
+		cov[4] += dg * db;
+		cov[5] += db * db;
+	}
+
+	//power iteration, starting from the covariance column of the channel that varies most
+	float axis[3];
+	if (cov[0] >= cov[3] && cov[0] >= cov[5])
+	{
+		axis[0] = cov[0]; axis[1] = cov[1]; axis[2] = cov[2];
+	}
+	else if (cov[3] >= cov[5])
+	{
+		axis[0] = cov[1]; axis[1] = cov[3]; axis[2] = cov[4];
+	}
+	else
+	{
+		axis[0] = cov[2]; axis[1] = cov[4]; axis[2] = cov[5];
+	}
+	for (int iteration = 0; iteration < 4; iteration++)
+	{
+		float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+		float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+		float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+		float largest = max(fabs(x), max(fabs(y), fabs(z)));
+		if (largest == 0.0f)
+			break;
+		axis[0] = x / largest;
+		axis[1] = y / largest;
+		axis[2] = z / largest;
+	}
+	float length = sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+
+	float e0[3], e1[3];
+	if (length > 0.0f)
+	{
+		for (float& a : axis)
+			a /= length;
+		float lo = FLT_MAX, hi = -FLT_MAX;
+		for (int i = 0; i < 16; i++)
+		{
+			float t = (r[i] - mean[0]) * axis[0] + (g[i] - mean[1]) * axis[1] + (b[i] - mean[2]) * axis[2];
+			lo = min(lo, t);
+			hi = max(hi, t);
+		}
+		for (int i = 0; i < 3; i++)
+		{
+			e0[i] = mean[i] + axis[i] * hi;
+			e1[i] = mean[i] + axis[i] * lo;
+		}
+	}
+	else
+	{
+		//a single color
+		memcpy(e0, mean, sizeof(mean));
+		memcpy(e1, mean, sizeof(mean));
+	}
+
+	unsigned char indices[16];
+	float error = EncodeColorEndpoints(r, g, b, e0, e1, out, indices);
+
+	//index i decodes to (1 - w) * c0 + w * c1
+	static const float weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	for (int iteration = 0; iteration < 2 && error > 0.0f; iteration++)
+	{
+		float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+		float ax[3] = { 0.0f, 0.0f, 0.0f }, bx[3] = { 0.0f, 0.0f, 0.0f };
+		for (int i = 0; i < 16; i++)
+		{
+			float beta = weights[indices[i]], alpha = 1.0f - beta;
+			aa += alpha * alpha;
+			ab += alpha * beta;
+			bb += beta * beta;
+			float texel[3] = { r[i], g[i], b[i] };
+			for (int c = 0; c < 3; c++)
+			{
+				ax[c] += alpha * texel[c];
+				bx[c] += beta * texel[c];
+			}
+		}
+		float det = aa * bb - ab * ab;
+		if (fabs(det) < 1e-6f)
+			break;
+		for (int c = 0; c < 3; c++)
+		{
+			e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+			e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+		}
+
+		unsigned char candidate[8], candidateIndices[16];
+		float candidateError = EncodeColorEndpoints(r, g, b, e0, e1, candidate, candidateIndices);
+		if (candidateError >= error)
+			break;
+		error = candidateError;
+		memcpy(out, candidate, 8);
+		memcpy(indices, candidateIndices, 16);
+	}
+}
+
+//BC4 block of 16 values (BC3 alpha, each BC5 channel): the extremes as endpoints, in the 8 value mode, and every value
+//rounded to the nearest of the 8 evenly spaced steps
+static void EncodeChannelBlock(const float values[16], unsigned char* out)
+{
+	float lo = values[0], hi = values[0];
+	for (int i = 1; i < 16; i++)
+	{
+		lo = min(lo, values[i]);
+		hi = max(hi, values[i]);
+	}
+	int e0 = (int)(hi + 0.5f), e1 = (int)(lo + 0.5f);
+	out[0] = (unsigned char)e0;
+	out[1] = (unsigned char)e1;
+
+	uint64_t bits = 0;
+	if (e0 > e1)
+	{
+		//step q goes from 0 at e0 to 7 at e1; index 0 is e0, index 1 is e1 and the steps in between are q + 1
+		float scale = 7.0f / (float)(e0 - e1);
+		int32_t steps[16];
+#ifdef BLOCK_COMPRESSION_SSE
+		__m128 top = _mm_set1_ps((float)e0);
+		__m128 scale4 = _mm_set1_ps(scale);
+		__m128 half = _mm_set1_ps(0.5f);
+		for (int i = 0; i < 16; i += 4)
+		{
+			__m128 q = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(top, _mm_loadu_ps(values + i)), scale4), half);
+			_mm_storeu_si128((__m128i*)(steps + i), _mm_cvttps_epi32(q));
+		}
+#else
+		for (int i = 0; i < 16; i++)
+			steps[i] = (int32_t)(((float)e0 - values[i]) * scale + 0.5f);
+#endif
+		for (int i = 0; i < 16; i++)
+		{
+			int q = min(max((int)steps[i], 0), 7);
+			uint64_t index = q == 0 ? 0 : (q == 7 ? 1 : q + 1);
+			bits |= index << (3 * i);
+		}
+	}
+	for (int i = 0; i < 6; i++)
+		out[2 + i] = (unsigned char)(bits >> (8 * i));
+}
+
+void CompressBlocks(BlockFormat format, const unsigned char* pixels, int width, int height, int components,
+	unsigned char* out, ThreadPool* pool)
+{
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	size_t blockBytes = BlockBytes(format);
+	//channel of the rgba block holding the second channel of the source (grey + alpha keeps it in alpha)
+	int second = components == 2 ? 3 : 1;
+
+	auto rows = [&](size_t begin, size_t end)
+	{
+		unsigned char block[64];
+		float values[16];
+		for (size_t by = begin; by < end; by++)
+		{
+			unsigned char* dst = out + by * blocksX * blockBytes;
+			for (int bx = 0; bx < blocksX; bx++, dst += blockBytes)
+			{
+				FetchBlock(pixels, width, height, components, bx, (int)by, block);
+				switch (format)
+				{
+				case BLOCK_FORMAT_BC1:
+					EncodeColorBlock(block, dst);
+					break;
+				case BLOCK_FORMAT_BC3:
+					for (int i = 0; i < 16; i++)
+						values[i] = block[4 * i + 3];
+					EncodeChannelBlock(values, dst);
+					EncodeColorBlock(block, dst + 8);
+					break;
+				case BLOCK_FORMAT_BC5:
+					for (int i = 0; i < 16; i++)
+						values[i] = block[4 * i];
+					EncodeChannelBlock(values, dst);
+					for (int i = 0; i < 16; i++)
+						values[i] = block[4 * i + second];
+					EncodeChannelBlock(values, dst + 8);
+					break;
+				default:
+					break;
+				}
+			}
+		}
+	};
+
+	//about a thousand blocks per chunk
+	size_t grain = max((size_t)1, (size_t)1024 / blocksX);
+	if (pool != NULL && (size_t)blocksY > grain)
+		pool->ParallelFor(blocksY, grain, rows);
+	else
+		rows(0, blocksY);
+}
+
+//16 rgba texels of a BC1 block. BC3 color blocks always use the 4 color mode
+static void DecodeColorBlock(const unsigned char* in, unsigned char block[64], bool alwaysFourColors)
+{
+	uint16_t c0 = (uint16_t)(in[0] | (in[1] << 8)), c1 = (uint16_t)(in[2] | (in[3] << 8));
+	int palette[4][4];
+	UnpackColor565(c0, palette[0]);
+	UnpackColor565(c1, palette[1]);
+	palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+	for (int i = 0; i < 3; i++)
+	{
+		if (c0 > c1 || alwaysFourColors)
+		{
+			palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+			palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+		}
+		else
+		{
+			palette[2][i] = (palette[0][i] + palette[1][i]) / 2;
+			palette[3][i] = 0;
+		}
+	}
+	if (!(c0 > c1 || alwaysFourColors))
+		palette[3][3] = 0;
+
+	uint32_t bits = in[4] | (in[5] << 8) | (in[6] << 16) | ((uint32_t)in[7] << 24);
+	for (int i = 0; i < 16; i++)
+	{
+		const int* color = palette[(bits >> (2 * i)) & 3];
+		for (int c = 0; c < 4; c++)
+			block[4 * i + c] = (unsigned char)color[c];
+	}
+}
+
+//16 values of a BC4 block, stride bytes apart
+static void DecodeChannelBlock(const unsigned char* in, unsigned char* out, int stride)
+{
+	int e0 = in[0], e1 = in[1];
+	int palette[8] = { e0, e1 };
+	if (e0 > e1)
+	{
+		for (int i = 2; i < 8; i++)
+			palette[i] = ((8 - i) * e0 + (i - 1) * e1) / 7;
+	}
+	else
+	{
+		for (int i = 2; i < 6; i++)
+			palette[i] = ((6 - i) * e0 + (i - 1) * e1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	uint64_t bits = 0;
+	for (int i = 0; i < 6; i++)
+		bits |= (uint64_t)in[2 + i] << (8 * i);
+	for (int i = 0; i < 16; i++)
+		out[i * stride] = (unsigned char)palette[(bits >> (3 * i)) & 7];
+}
+
+void DecompressBlocks(BlockFormat format, const unsigned char* blocks, int width, int height, unsigned char* rgba)
+{
+	int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+	size_t blockBytes = BlockBytes(format);
+	unsigned char block[64];
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++, blocks += blockBytes)
+		{
+			switch (format)
+			{
+			case BLOCK_FORMAT_BC1:
+				DecodeColorBlock(blocks, block, false);
+				break;
+			case BLOCK_FORMAT_BC3:
+				DecodeColorBlock(blocks + 8, block, true);
+				DecodeChannelBlock(blocks, block + 3, 4);
+				break;
+			case BLOCK_FORMAT_BC5:
+				DecodeChannelBlock(blocks, block, 4);
+				DecodeChannelBlock(blocks + 8, block + 1, 4);
+				for (int i = 0; i < 16; i++)
+				{
+					block[4 * i + 2] = 0;
+					block[4 * i + 3] = 255;
+				}
+				break;
+			default:
+				return;
+			}
+
+			for (int y = 0; y < 4 && 4 * by + y < height; y++)
+			{
+				int columns = min(4, width - 4 * bx);
+				memcpy(rgba + ((size_t)(4 * by + y) * width + 4 * bx) * 4, block + 16 * y, columns * 4);
+			}
+		}
+	}
+}
+
+//PSNR over the given channels of two rgba images
+static double Psnr(const unsigned char* a, const unsigned char* b, size_t texels, const int* channels, int nChannels)
+{
+	double sum = 0.0;
+	for (size_t t = 0; t < texels; t++)
+	{
+		for (int c = 0; c < nChannels; c++)
+		{
+			double d = (double)a[4 * t + channels[c]] - (double)b[4 * t + channels[c]];
+			sum += d * d;
+		}
+	}
+	double mse = sum / ((double)texels * nChannels);
+	return mse == 0.0 ? 99.0 : 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+void RunCompressionBenchmark(const char* imagePath)
+{
+	const int runs = 5;
+	int width, height, components;
+	unsigned char* pixels = stbi_load(imagePath, &width, &height, &components, 0);
+	if (pixels == NULL)
+	{
+		printf("Texture failed to load at path: %s\n", imagePath);
+		return;
+	}
+
+	//what the encoder sees: the source as rgba. For BC5 the second source channel is compared against green
+	size_t texels = (size_t)width * height;
+	std::vector<unsigned char> reference(texels * 4), referenceRG(texels * 4);
+	for (size_t t = 0; t < texels; t++)
+	{
+		ExpandTexel(pixels + t * components, components, &reference[4 * t]);
+		referenceRG[4 * t] = reference[4 * t];
+		referenceRG[4 * t + 1] = reference[4 * t + (components == 2 ? 3 : 1)];
+	}
+
+	ThreadPool pool;
+	std::vector<unsigned char> decoded(texels * 4);
+	static const int rgb[3] = { 0, 1, 2 }, rgba[4] = { 0, 1, 2, 3 }, rg[2] = { 0, 1 };
+
+	printf("%s: %dx%d, %d channels\n", imagePath, width, height, components);
+	printf("format, threads, ms, source MB/s, psnr\n");
+	for (BlockFormat format : { BLOCK_FORMAT_BC1, BLOCK_FORMAT_BC3, BLOCK_FORMAT_BC5 })
+	{
+		std::vector<unsigned char> blocks(CompressedSize(format, width, height));
+		for (ThreadPool* threads : { (ThreadPool*)NULL, &pool })
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int run = 0; run < runs; run++)
+				CompressBlocks(format, pixels, width, height, components, blocks.data(), threads);
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			double ms = elapsed.count() / runs;
+			//rate over the rgba source, the same for every format
+			double rate = (double)texels * 4 / (1 << 20) / (ms / 1000.0);
+
+			DecompressBlocks(format, blocks.data(), width, height, decoded.data());
+			double psnr;
+			if (format == BLOCK_FORMAT_BC1)
+				psnr = Psnr(reference.data(), decoded.data(), texels, rgb, 3);
+			else if (format == BLOCK_FORMAT_BC3)
+				psnr = Psnr(reference.data(), decoded.data(), texels, rgba, 4);
+			else
+				psnr = Psnr(referenceRG.data(), decoded.data(), texels, rg, 2);
+
+			const char* names[] = { "none", "BC1", "BC3", "BC5" };
+			printf("%s, %u, %.2f, %.1f, %.2f\n", names[format], threads ? threads->ThreadCount() : 1, ms, rate, psnr);
+		}
+	}
+	stbi_image_free(pixels);
+}
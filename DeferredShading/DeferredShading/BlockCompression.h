@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+
+#include "ThreadPool.h"
+
+//block compressed formats: every 4x4 texel block is encoded independently into 8 or 16 bytes
+enum BlockFormat
+{
+	BLOCK_FORMAT_NONE, //uncompressed
+	BLOCK_FORMAT_BC1,  //rgb, 8 bytes (4 bits per texel): two 565 endpoints and 2-bit indices
+	BLOCK_FORMAT_BC3,  //rgba, 16 bytes: a BC4 alpha block followed by a BC1 color block
+	BLOCK_FORMAT_BC5   //rg, 16 bytes: one BC4 block per channel. Used for the x, y of normal maps
+};
+
+//bytes of one block (0 for BLOCK_FORMAT_NONE)
+size_t BlockBytes(BlockFormat format);
+
+//bytes of a width x height image in format, partial blocks on the right/bottom edges rounded up to whole blocks
+size_t CompressedSize(BlockFormat format, int width, int height);
+
+//encodes a width x height image of 1 to 4 channels (grey, grey + alpha, rgb, rgba) into out, CompressedSize bytes.
+//BC5 encodes the first two channels. Endpoints are fitted along the principal axis of each block and refined by
+//least squares, and the index search tests 4 texels at a time with SSE2 when available. With a pool the rows of
+//blocks are split over its threads
+void CompressBlocks(BlockFormat format, const unsigned char* pixels, int width, int height, int components,
+	unsigned char* out, ThreadPool* pool);
+
+//decodes blocks back into a width x height rgba image (BC5: r, g, 0, 255), as the gpu would sample level 0
+void DecompressBlocks(BlockFormat format, const unsigned char* blocks, int width, int height, unsigned char* rgba);
+
+//encodes the image at imagePath in each format, serially and on every core, and prints the encoding rate and the PSNR
+//of the decoded result
+void RunCompressionBenchmark(const char* imagePath);
@@ -0,0 +1,276 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "lodepng.h"
+#include "FrameCapture.h"
+#include "QoiCodec.h"
+
+using namespace std;
+
+FrameCapture::FrameCapture()
+{
+	for (Slot& slot : ring)
+	{
+		slot.pbo = 0;
+		slot.bytes = 0;
+		slot.fence = 0;
+		slot.width = slot.height = 0;
+	}
+	next = oldest = inFlight = 0;
+	encoding = 0;
+	maxQueued = 0;
+	deflateThreads = 1;
+	stopping = false;
+	captured = dropped = stalls = 0;
+	readbackMs = encodeMs = 0.0;
+	readbackBytes = encodedBytes = encodedFrames = 0;
+}
+
+FrameCapture::~FrameCapture()
+{
+	//the queued frames are still written
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+
+	//the PBOs and fences die with the context
+}
+
+void FrameCapture::Initialize(unsigned int nThreads)
+{
+	if (nThreads == 0)
+		nThreads = max(1u, std::thread::hardware_concurrency() / 2);
+	//frames waiting for an encoder, beyond which captures are dropped: about a frame of slack per thread
+	maxQueued = 2 * nThreads;
+	deflateThreads = max(1u, std::thread::hardware_concurrency() / nThreads);
+
+	for (unsigned int i = 0; i < nThreads; i++)
+		workers.emplace_back(&FrameCapture::WorkerLoop, this);
+}
+
+void FrameCapture::Capture(int width, int height, const std::string& path)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (jobs.size() + inFlight >= maxQueued + CAPTURE_RING_SIZE)
+		{
+			dropped++;
+			return;
+		}
+	}
+
+	auto start = std::chrono::high_resolution_clock::now();
+	if (inFlight == CAPTURE_RING_SIZE)
+	{
+		//the ring is full: the oldest readback is CAPTURE_RING_SIZE frames old and almost surely done
+		Collect(true);
+	}
+
+	Slot& slot = ring[next];
+	size_t bytes = (size_t)width * height * 4;
+	if (slot.pbo == 0)
+		glGenBuffers(1, &slot.pbo);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	if (slot.bytes < bytes)
+	{
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, NULL, GL_STREAM_READ);
+		slot.bytes = bytes;
+	}
+
+	//rgba is the format the drivers read back without conversion; rows are 4 byte aligned for any width
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glReadBuffer(GL_BACK);
+	glPixelStorei(GL_PACK_ALIGNMENT, 4);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.width = width;
+	slot.height = height;
+	slot.path = path;
+	next = (next + 1) % CAPTURE_RING_SIZE;
+	inFlight++;
+	captured++;
+
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	readbackMs += elapsed.count();
+}
+
+//moves the oldest readback, if its fence has signaled (or, with wait, once it does), out of its PBO and into the
+//encoder queue
+void FrameCapture::Collect(bool wait)
+{
+	Slot& slot = ring[oldest];
+	GLenum status = glClientWaitSync(slot.fence, 0, 0);
+	if (status == GL_TIMEOUT_EXPIRED)
+	{
+		if (!wait)
+			return;
+		stalls++;
+		while (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull) == GL_TIMEOUT_EXPIRED)
+		{
+		}
+	}
+	glDeleteSync(slot.fence);
+	slot.fence = 0;
+
+	Job job;
+	size_t bytes = (size_t)slot.width * slot.height * 4;
+	job.pixels.resize(bytes);
+	job.width = slot.width;
+	job.height = slot.height;
+	job.path = slot.path;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.pbo);
+	const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+	if (data != NULL)
+	{
+		memcpy(job.pixels.data(), data, bytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	else
+	{
+		cout << "FrameCapture: glMapBufferRange failed, " << slot.path << " not written" << endl;
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	oldest = (oldest + 1) % CAPTURE_RING_SIZE;
+	inFlight--;
+	if (data == NULL)
+		return;
+	readbackBytes += bytes;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+void FrameCapture::Update()
+{
+	if (inFlight == 0)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	int collected = 0;
+	while (inFlight > 0)
+	{
+		int before = inFlight;
+		Collect(false);
+		if (inFlight == before)
+			break;
+		collected++;
+	}
+	if (collected > 0)
+	{
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		readbackMs += elapsed.count();
+	}
+}
+
+void FrameCapture::Finish()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+	while (inFlight > 0)
+		Collect(true);
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	readbackMs += elapsed.count();
+
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [&] { return jobs.empty() && encoding == 0; });
+}
+
+void FrameCapture::WorkerLoop()
+{
+	while (true)
+	{
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || !jobs.empty(); });
+			if (jobs.empty())
+				return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			encoding++;
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+
+		//glReadPixels returns the bottom row first. The default framebuffer's alpha is whatever the last pass wrote, and
+		//the capture should be opaque
+		size_t rowBytes = (size_t)job.width * 4;
+		std::vector<unsigned char> row(rowBytes);
+		for (int y = 0; y < job.height / 2; y++)
+		{
+			unsigned char* top = &job.pixels[y * rowBytes];
+			unsigned char* bottom = &job.pixels[(job.height - 1 - y) * rowBytes];
+			memcpy(row.data(), top, rowBytes);
+			memcpy(top, bottom, rowBytes);
+			memcpy(bottom, row.data(), rowBytes);
+		}
+		for (size_t i = 3; i < job.pixels.size(); i += 4)
+			job.pixels[i] = 255;
+
+		if (job.path.size() > 4 && job.path.compare(job.path.size() - 4, 4, ".qoi") == 0)
+		{
+			if (!SaveQoi(job.path, job.pixels.data(), job.width, job.height, 3))
+				cout << "FrameCapture: could not write " << job.path << endl;
+		}
+		else
+		{
+			lodepng::State state;
+			lodepng_compress_settings_init_fast(&state.encoder.zlibsettings);
+			state.encoder.zlibsettings.threads = deflateThreads;
+			std::vector<unsigned char> png;
+			unsigned error = lodepng::encode(png, job.pixels, job.width, job.height, state);
+			if (!error)
+				error = lodepng::save_file(png, job.path);
+			if (error)
+				cout << "encoder error " << error << ": " << lodepng_error_text(error) << endl;
+		}
+
+		auto end = std::chrono::high_resolution_clock::now();
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			std::chrono::duration<double, std::milli> elapsed = end - start;
+			if (encodedFrames == 0)
+				firstEncode = start;
+			lastEncode = max(lastEncode, end);
+			encodeMs += elapsed.count();
+			encodedBytes += job.pixels.size();
+			encodedFrames++;
+			encoding--;
+		}
+		idle.notify_all();
+	}
+}
+
+void FrameCapture::Report()
+{
+	if (captured == 0 && dropped == 0)
+		return;
+
+	std::lock_guard<std::mutex> lock(mutex);
+	const double MB = 1024.0 * 1024.0;
+	cout << "frame capture: " << captured << " captured, " << dropped << " dropped, " << stalls << " readback stalls" << endl;
+	if (captured > 0)
+	{
+		cout << "  readback: " << readbackMs / captured << " ms per frame on the render thread, "
+			<< (readbackMs > 0.0 ? readbackBytes / MB / (readbackMs / 1000.0) : 0.0) << " MB/s" << endl;
+	}
+	if (encodedFrames > 0)
+	{
+		std::chrono::duration<double, std::milli> wall = lastEncode - firstEncode;
+		cout << "  encode: " << encodeMs / encodedFrames << " ms per frame on " << workers.size() << " threads, "
+			<< (wall.count() > 0.0 ? encodedBytes / MB / (wall.count() / 1000.0) : 0.0) << " MB/s of pixels" << endl;
+	}
+}
@@ -0,0 +1,89 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+//asynchronous frame capture to png. Capture reads the back buffer into the next pixel buffer object of a ring of
+//CAPTURE_RING_SIZE and fences it; Update collects readbacks whose fence has signaled, usually one or two frames later,
+//so the render thread never waits for the gpu. Collecting is a single copy out of the mapped PBO; the rows are flipped
+//and encoded on the worker threads. When the encoders fall too far behind, new captures are dropped (and counted)
+//instead of stalling the render loop. PNGs are written with lodepng's fast preset, each deflated on several threads;
+//paths ending in .qoi are written as QOI (QoiCodec.h), many times faster to encode, for long capture sequences.
+class FrameCapture
+{
+public:
+	FrameCapture();
+	~FrameCapture();
+
+	FrameCapture(const FrameCapture&) = delete;
+	FrameCapture& operator=(const FrameCapture&) = delete;
+
+	//starts the encoder threads. nThreads == 0: half the hardware threads, at least 1
+	void Initialize(unsigned int nThreads = 0);
+
+	//gl thread, after the frame is drawn and before the swap: queues the back buffer (width x height) to be written to path,
+	//as png or, if path ends in .qoi, as qoi
+	void Capture(int width, int height, const std::string& path);
+
+	//gl thread, once per frame: hands the finished readbacks to the encoders
+	void Update();
+
+	//gl thread: waits for every readback and every encode
+	void Finish();
+
+	//prints frames captured and dropped, readback stalls, and readback/encode throughput
+	void Report();
+
+private:
+	static const int CAPTURE_RING_SIZE = 3;
+
+	struct Slot
+	{
+		unsigned int pbo;
+		size_t bytes; //allocated
+		GLsync fence; //0 when the slot is free
+		int width, height;
+		std::string path;
+	};
+
+	struct Job
+	{
+		std::vector<unsigned char> pixels; //rgba, bottom row first, as read
+		int width, height;
+		std::string path;
+	};
+
+	std::array<Slot, CAPTURE_RING_SIZE> ring;
+	int next;     //slot of the next Capture
+	int oldest;   //slot of the next readback to collect, in capture order
+	int inFlight; //slots holding a readback
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::deque<Job> jobs;
+	size_t encoding; //jobs taken by a worker and not finished
+	size_t maxQueued;
+	unsigned int deflateThreads; //per encode, so that all encoders together use about every hardware thread
+	bool stopping;
+
+	//statistics. The render thread ones are only touched by the gl thread, the encode ones under mutex
+	size_t captured, dropped, stalls;
+	double readbackMs;
+	size_t readbackBytes;
+	double encodeMs;
+	size_t encodedBytes, encodedFrames;
+	std::chrono::high_resolution_clock::time_point firstEncode, lastEncode;
+
+	void Collect(bool wait);
+	void WorkerLoop();
+};
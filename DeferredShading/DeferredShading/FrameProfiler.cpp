@@ -0,0 +1,189 @@
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+#include "FrameProfiler.h"
+
+using namespace std;
+
+static const char* gpuSectionNames[FrameProfiler::N_GPU_SECTIONS] = { "gpu geometry pass", "gpu lighting pass", "gpu present" };
+static const char* cpuSectionNames[FrameProfiler::N_CPU_SECTIONS] = { "cpu processInput", "cpu UpdateMVPMatrix", "cpu uniform upload", "cpu light binning" };
+
+//p in [0, 1]. samples must be sorted
+static double Percentile(const std::vector<double>& sorted, double p)
+{
+	if (sorted.empty())
+		return 0.0;
+	size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[min(i, sorted.size() - 1)];
+}
+
+static void PrintStats(const char* name, std::vector<double> samples)
+{
+	if (samples.empty())
+	{
+		cout << name << ": no samples" << endl;
+		return;
+	}
+
+	double total = 0.0;
+	for (double s : samples)
+		total += s;
+
+	//rolling average over the last 60 frames
+	size_t window = min(samples.size(), (size_t)60);
+	double rolling = 0.0;
+	for (size_t i = samples.size() - window; i < samples.size(); i++)
+		rolling += samples[i];
+
+	std::sort(samples.begin(), samples.end());
+	cout << name << ": avg " << total / samples.size() << " ms, last60 " << rolling / window
+		<< " ms, p50 " << Percentile(samples, 0.5) << " ms, p95 " << Percentile(samples, 0.95)
+		<< " ms, p99 " << Percentile(samples, 0.99) << " ms, max " << samples.back() << " ms" << endl;
+}
+
+FrameProfiler::FrameProfiler()
+{
+	initialized = false;
+	frame = 0;
+	cpuAccum.fill(0.0);
+	queryFrame.fill(0);
+	for (auto& slot : queryIssued)
+		slot.fill(false);
+}
+
+FrameProfiler::~FrameProfiler()
+{
+	//the queries die with the context; nothing to release here
+}
+
+void FrameProfiler::Initialize()
+{
+	for (int i = 0; i < PROFILER_RING_SIZE; i++)
+	{
+		glGenQueries(N_GPU_SECTIONS, queries[i].data());
+	}
+	initialized = true;
+}
+
+void FrameProfiler::BeginFrame()
+{
+	cpuAccum.fill(0.0);
+
+	if (!initialized)
+		return;
+
+	//the slot we are about to reuse was issued PROFILER_RING_SIZE frames ago: its results should be ready by now
+	CollectRingSlot(frame % PROFILER_RING_SIZE, false);
+}
+
+void FrameProfiler::EndFrame()
+{
+	for (int i = 0; i < N_CPU_SECTIONS; i++)
+	{
+		cpuSamples[i].push_back(cpuAccum[i]);
+	}
+	frame++;
+}
+
+void FrameProfiler::BeginGPU(GPUSection section)
+{
+	if (!initialized)
+		return;
+	glBeginQuery(GL_TIME_ELAPSED, queries[frame % PROFILER_RING_SIZE][section]);
+}
+
+void FrameProfiler::EndGPU(GPUSection section)
+{
+	if (!initialized)
+		return;
+	glEndQuery(GL_TIME_ELAPSED);
+	queryIssued[frame % PROFILER_RING_SIZE][section] = true;
+	queryFrame[frame % PROFILER_RING_SIZE] = frame;
+}
+
+void FrameProfiler::BeginCPU(CPUSection section)
+{
+	cpuStart[section] = std::chrono::high_resolution_clock::now();
+}
+
+void FrameProfiler::EndCPU(CPUSection section)
+{
+	std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - cpuStart[section];
+	cpuAccum[section] += elapsed.count();
+}
+
+//reads back the queries of a ring slot. If wait is false, results that are not available yet are dropped instead of stalling
+void FrameProfiler::CollectRingSlot(int slot, bool wait)
+{
+	for (int i = 0; i < N_GPU_SECTIONS; i++)
+	{
+		if (!queryIssued[slot][i])
+			continue;
+		queryIssued[slot][i] = false;
+
+		GLint available = 0;
+		if (!wait)
+		{
+			glGetQueryObjectiv(queries[slot][i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+		}
+
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(queries[slot][i], GL_QUERY_RESULT, &elapsed);
+		gpuSamples[i].push_back(elapsed / 1000000.0);
+		gpuSampleFrames[i].push_back(queryFrame[slot]);
+	}
+}
+
+void FrameProfiler::Report(const char* csvPath)
+{
+	if (initialized)
+	{
+		//flush the frames still in flight, oldest first; we are exiting, so waiting is fine
+		for (int i = 0; i < PROFILER_RING_SIZE; i++)
+		{
+			CollectRingSlot((frame + i) % PROFILER_RING_SIZE, true);
+		}
+	}
+
+	cout << "---- profile (" << frame << " frames) ----" << endl;
+	for (int i = 0; i < N_GPU_SECTIONS; i++)
+		PrintStats(gpuSectionNames[i], gpuSamples[i]);
+	for (int i = 0; i < N_CPU_SECTIONS; i++)
+		PrintStats(cpuSectionNames[i], cpuSamples[i]);
+
+	if (csvPath == NULL)
+		return;
+
+	//one row per frame, one column per section. Frames whose gpu results were dropped get empty gpu cells
+	std::ofstream csv(csvPath);
+	csv << "frame,";
+	for (int i = 0; i < N_GPU_SECTIONS; i++)
+		csv << gpuSectionNames[i] << ",";
+	for (int i = 0; i < N_CPU_SECTIONS; i++)
+		csv << cpuSectionNames[i] << (i + 1 < N_CPU_SECTIONS ? "," : "");
+	csv << endl;
+
+	std::array<size_t, N_GPU_SECTIONS> next;
+	next.fill(0);
+	for (int f = 0; f < frame; f++)
+	{
+		csv << f << ",";
+		for (int i = 0; i < N_GPU_SECTIONS; i++)
+		{
+			if (next[i] < gpuSampleFrames[i].size() && gpuSampleFrames[i][next[i]] == f)
+				csv << gpuSamples[i][next[i]++];
+			csv << ",";
+		}
+		for (int i = 0; i < N_CPU_SECTIONS; i++)
+		{
+			if ((size_t)f < cpuSamples[i].size())
+				csv << cpuSamples[i][f];
+			csv << (i + 1 < N_CPU_SECTIONS ? "," : "");
+		}
+		csv << endl;
+	}
+	csv.close();
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <vector>
+
+#include <glad/glad.h>
+
+//per-pass profiler for the render loop.
+//gpu sections are timed with GL_TIME_ELAPSED queries kept in a ring of PROFILER_RING_SIZE frames, so results are
+//only read back a few frames later, when they are already available, and the cpu never stalls waiting for them.
+//cpu sections are timed with a high resolution clock. Sections of the same kind may not overlap.
+class FrameProfiler
+{
+public:
+	enum GPUSection { GPU_GEOMETRY_PASS, GPU_LIGHTING_PASS, GPU_PRESENT, N_GPU_SECTIONS };
+	enum CPUSection { CPU_PROCESS_INPUT, CPU_UPDATE_MVP, CPU_UNIFORM_UPLOAD, CPU_LIGHT_BINNING, N_CPU_SECTIONS };
+
+	FrameProfiler();
+	~FrameProfiler();
+
+	//creates the query objects. Needs a current opengl context
+	void Initialize();
+
+	void BeginFrame();
+	void EndFrame();
+
+	void BeginGPU(GPUSection section);
+	void EndGPU(GPUSection section);
+
+	//cpu sections accumulate if opened more than once in the same frame
+	void BeginCPU(CPUSection section);
+	void EndCPU(CPUSection section);
+
+	//prints average and percentiles of every section to the console and, if csvPath != NULL, dumps every sample to it
+	void Report(const char* csvPath);
+
+private:
+	static const int PROFILER_RING_SIZE = 4;
+
+	bool initialized;
+	int frame;
+
+	std::array<std::array<unsigned int, N_GPU_SECTIONS>, PROFILER_RING_SIZE> queries;
+	std::array<std::array<bool, N_GPU_SECTIONS>, PROFILER_RING_SIZE> queryIssued;
+	std::array<int, PROFILER_RING_SIZE> queryFrame; //frame that issued the queries of each slot
+
+	std::array<std::chrono::high_resolution_clock::time_point, N_CPU_SECTIONS> cpuStart;
+	std::array<double, N_CPU_SECTIONS> cpuAccum;
+
+	//samples in milliseconds
+	std::array<std::vector<double>, N_GPU_SECTIONS> gpuSamples;
+	std::array<std::vector<int>, N_GPU_SECTIONS> gpuSampleFrames; //frame of each gpu sample: dropped results leave gaps
+	std::array<std::vector<double>, N_CPU_SECTIONS> cpuSamples;
+
+	void CollectRingSlot(int slot, bool wait);
+};
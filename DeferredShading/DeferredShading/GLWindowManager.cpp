@@ -2,6 +2,7 @@
 #include <iostream>
 #include <fstream>
 #include <istream>
+#include <sstream>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -11,50 +12,25 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/hash.hpp>
 #include <time.h>
+#include <cfloat>
+#include <cstring>
+#include <chrono>
 #include <unordered_map>
 
-#include "lodepng.h"
-
 #include <random>
 
 
-#define TINYOBJLOADER_IMPLEMENTATION
-//#include <tiny_obj_loader.h>
-
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
 #include "GLWindowManager.h"
+#include "MeshOptimizer.h"
+#include "ObjLoader.h"
 
 
 
 using namespace std;
 
-void GLWindowManager::FBO_2_file()
-{
-	FILE    *output_image;
-	int     output_width, output_height;
-
-	output_width = screenWidth;
-	output_height = screenHeight;
-
-	/// READ THE PIXELS VALUES from FBO AND SAVE TO A FILE
-	int             i, j, k;
-	unsigned char   *pixels = (unsigned char*)malloc(output_width*output_height * 4);
-
-	/// READ THE CONTENT FROM THE FBO
-	//glPixelStorei(GL_PACK_ALIGNMENT, 1); ??
-	glReadBuffer(GL_FRONT);
-	glReadPixels(0, 0, output_width, output_height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
-
-	//Encode the image
-	unsigned error = lodepng::encode("output.png", pixels, width, height);
-
-	//if there's an error, display it
-	if (error) std::cout << "encoder error " << error << ": " << lodepng_error_text(error) << std::endl;
-
-	free(pixels);
-}
 
 //one callback definition(could not put it inside the class for some reason)
 static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
@@ -62,49 +38,6 @@ static void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 	glViewport(0, 0, width, height);
 }
 
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int GLWindowManager::loadTexture(char const * path)
-{
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
-
-	int width, height, nrComponents;
-	unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-
-	if (data)
-	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-
-		cout << width << "," << height << endl;
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
-	}
-	else
-	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
-	}
-
-	return textureID;
-}
-
-
 void GLWindowManager::processInput(GLFWwindow *window)
 {
 	//habilita usurio a fechar a janela apertando escape
@@ -214,6 +147,14 @@ void GLWindowManager::processInput(GLFWwindow *window)
 		cout << "selectTexture: bitangent" << endl;
 	}
 
+	//captura a tela uma vez por aperto da tecla
+	bool captureKey = glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS;
+	if (captureKey && !captureKeyDown)
+	{
+		captureRequested = true;
+	}
+	captureKeyDown = captureKey;
+
 
 
 
@@ -227,28 +168,34 @@ std::string GLWindowManager::readShaderFile(const char* name)
 	if (in.fail())
 	{
 		//aborta
-		cerr << "IO error opening file on vertex.vert. Aborting" << std::endl;
+		cerr << "IO error opening file " << name << ". Aborting" << std::endl;
 		exit(1);
 	}
 
-	char a;
-	while (in.get(a) && a != EOF)
-	{
-		shader += a;
-	}
-	shader += '\0';
+	//l o arquivo inteiro de uma vez
+	std::stringstream contents;
+	contents << in.rdbuf();
+	shader = contents.str();
 	in.close();
 	return shader;
 }
 
-void GLWindowManager::BuildShader(const char* filepath, unsigned int* shaderID, int shader_enum)
+//compiles shaderString, read from filepath (used only in error messages), with the permutation defines injected right
+//after its #version line. #line keeps the line numbers of compile errors those of the file
+void GLWindowManager::BuildShader(const char* filepath, const std::string& shaderString, const std::string& defines, unsigned int* shaderID, int shader_enum)
 {
-	std::string shaderString = readShaderFile(filepath);
+	std::string source = shaderString;
+	if (!defines.empty())
+	{
+		size_t versionEnd = source.find('\n', source.find("#version"));
+		if (versionEnd != std::string::npos)
+			source.insert(versionEnd + 1, defines + "#line 2\n");
+	}
 
 	//cria objeto shader
 	*shaderID = glCreateShader(shader_enum);
 	//attach shader source code to the shader object and compile the shader
-	const char *c_str = shaderString.c_str(); // glShaderSource espera no 3o param um array de c-like strings. Nesse caso, s temos uma string nesse array. No 2o param est explcita esta informao
+	const char *c_str = source.c_str(); // glShaderSource espera no 3o param um array de c-like strings. Nesse caso, s temos uma string nesse array. No 2o param est explcita esta informao
 	glShaderSource(*shaderID, 1, &c_str, NULL);
 	glCompileShader(*shaderID);
 
@@ -259,182 +206,300 @@ void GLWindowManager::BuildShader(const char* filepath, unsigned int* shaderID,
 	if (!success)
 	{
 		glGetShaderInfoLog(*shaderID, 512, NULL, infoLog);
-		std::cerr << "ERROR::SHADER::VERTEX/FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
+		std::cerr << "ERROR::SHADER::VERTEX/FRAGMENT::COMPILATION_FAILED " << filepath << "\n" << infoLog << std::endl;
 		exit(1);
 	}
 }
 
-	//updates model-view-projection matrix based on current values for the eye, scale etc.
-void GLWindowManager::UpdateMVPMatrix()
+//links a program from a vertex and a fragment shader file, or loads it from the program binary cache under name
+//when the sources, the defines and the driver are the same as when it was stored
+unsigned int GLWindowManager::BuildProgram(const char* name, const char* vertexPath, const char* fragmentPath, const std::string& defines)
 {
-	//construct model, view and projection matrices:
+	std::vector<std::string> sources = { readShaderFile(vertexPath), readShaderFile(fragmentPath), defines };
+	uint64_t key = programCache.Key(sources);
 
-	glm::mat4 Projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, 0.1f, 100.0f);
+	unsigned int program = glCreateProgram();
+	if (programCache.Load(name, key, program))
+	{
+		cachedPrograms++;
+		return program;
+	}
 
-	glm::mat4 View = glm::lookAt(eye, cameraTarget, up);
+	unsigned int vertexShader, fragmentShader;
+	BuildShader(vertexPath, sources[0], defines, &vertexShader, GL_VERTEX_SHADER);
+	BuildShader(fragmentPath, sources[1], defines, &fragmentShader, GL_FRAGMENT_SHADER);
 
-	model = glm::scale(glm::mat4(1.0f), glm::vec3(scale)) * glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 1.0f, 0.0f));
+	//attach shader to program
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	if (programCache.IsEnabled())
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	glLinkProgram(program);
 
+	//check for linking errors:
+	int success;
+	char infoLog[512];
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (!success) {
+		glGetProgramInfoLog(program, 512, NULL, infoLog);
+		std::cerr << "ERROR::SHADER::LINKING_ERROR " << name << "\n" << infoLog << std::endl;
+	}
+	else if (programCache.IsEnabled() && !programCache.Store(name, key, program))
+	{
+		std::cerr << "could not write the program cache of " << name << std::endl;
+	}
 
-	
-	view = View;
-	modelView = View * model;
-	modelViewProjection = Projection * View * model;
+	//deleta os objetos shader, que j cumpriram sua funo
+	glDetachShader(program, vertexShader);
+	glDetachShader(program, fragmentShader);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
 
-	//a inversa transposta da modelView
-	//primeiro inverte e depois tranpe?
-	ITmodelView = glm::transpose(glm::inverse(modelView));
+	compiledPrograms++;
+	return program;
 }
 
-GLWindowManager::GLWindowManager()
+//#defines of a shader permutation: none for the generic shaders, otherwise SPECIALIZED and every feature as a constant
+static std::string PermutationDefines(uint32_t permutation)
 {
-	IsTextureLoaded = false;
-	IsBumpmapLoaded = false;
-	data = NULL;
-	bump_data = NULL;
-	
+	if (!(permutation & PERMUTATION_SPECIALIZED))
+		return std::string();
+
+	std::stringstream defines;
+	defines << "#define SPECIALIZED\n";
+	defines << "#define NORMAL_MAP " << ((permutation & PERMUTATION_NORMAL_MAP) ? "true" : "false") << "\n";
+	defines << "#define COMPACT_GBUFFER " << ((permutation & PERMUTATION_COMPACT_GBUFFER) ? "true" : "false") << "\n";
+	defines << "#define TILED_LIGHTING " << ((permutation & PERMUTATION_TILED_LIGHTING) ? "true" : "false") << "\n";
+	defines << "#define LIGHT_VOLUME " << ((permutation & PERMUTATION_LIGHT_VOLUME) ? "true" : "false") << "\n";
+	defines << "#define LIGHT_COUNT " << ((permutation >> PERMUTATION_LIGHT_COUNT_SHIFT) & 0xFF) << "\n";
+	defines << "#define DEBUG_VIEW " << ((permutation >> PERMUTATION_DEBUG_VIEW_SHIFT) & 0xFF) << "\n";
+	return defines.str();
 }
 
-GLWindowManager::~GLWindowManager()
+//program of a pass for a permutation, built (and, after InitializeProgramUniforms, set up) on first use
+unsigned int GLWindowManager::ProgramVariant(const char* pass, const char* vertexPath, const char* fragmentPath, uint32_t permutation)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%s.%08x", pass, permutation);
+	auto found = programVariants.find(name);
+	if (found != programVariants.end())
+		return found->second;
+
+	unsigned int program = BuildProgram(name, vertexPath, fragmentPath, PermutationDefines(permutation));
+	programVariants[name] = program;
+	if (programUniformsInitialized)
+		SetupProgram(program);
+	return program;
+}
+
+//the light count of an lPass permutation: nLights rounded up to a power of two, so the O/P keys only ever need
+//a handful of variants. The shader stops its loop at nLights
+static uint32_t LightCountBucket(int nLights)
+{
+	if (nLights <= 0)
+		return 0;
+	uint32_t bucket = 1;
+	while (bucket < (uint32_t)nLights)
+		bucket <<= 1;
+	return bucket;
+}
+
+//a texture or bump map that failed to load keeps its placeholder: the passes stop treating it as loaded. The next
+//SelectShaderVariants drops the NORMAL_MAP gPass; the generic shaders get their normalMapping uniform again
+void GLWindowManager::HandleFailedTextures()
 {
-	//libera memria, se != null
-	if (data != NULL)
+	bool changed = false;
+	for (unsigned int texture : textureLoader.TakeFailed())
 	{
-		stbi_image_free(data);
+		if (texture == tex1 && IsTextureLoaded)
+		{
+			IsTextureLoaded = false;
+			changed = true;
+		}
+		if (texture == tex2 && IsBumpmapLoaded)
+		{
+			IsBumpmapLoaded = false;
+			changed = true;
+		}
 	}
-
-	if (bump_data != NULL)
+	if (changed && programUniformsInitialized)
 	{
-		stbi_image_free(bump_data);
+		for (auto& variant : programVariants)
+			SetupProgram(variant.second);
 	}
-	
 }
 
-//pra usar a unordered map abaixo, precisamos implementar o == e uma funo hash:
-struct Vertex {
-	glm::vec3 position;
-	glm::vec3 color;
-	glm::vec3 normal;
-	glm::vec2 texcoord;
-	glm::vec3 tangent;
-	glm::vec3 bitangent;
-
-	bool operator==(const Vertex& other) const {
-		return position == other.position && color == other.color && texcoord == other.texcoord; //no exigimos que as normais, tangentes e bitangentes sejam iguais
+//picks the permutation of every pass for the current state. With specialized shaders the light count and the debug view
+//change at run time, so a new dPass variant may be built here mid frame (once; it is cached afterwards). allLightCounts
+//also builds the lPass of every light count bucket up to 32, so changing the light count never compiles mid frame
+void GLWindowManager::SelectShaderVariants(bool allLightCounts)
+{
+	uint32_t common = 0;
+	uint32_t lightCount = 0;
+	uint32_t debugView = 0;
+	if (specializedShaders)
+	{
+		common = PERMUTATION_SPECIALIZED | (compactGBuffer ? PERMUTATION_COMPACT_GBUFFER : 0);
+		//the tiled and volume paths never run the loop over the Lights block
+		lightCount = (tiledLighting || lightVolumes) ? 0 : LightCountBucket(nLights);
+		debugView = selectTexture;
 	}
 
-};
+	gPass = ProgramVariant("gPass", "Gvertex.vert", "Gfragment.frag", common | (specializedShaders && IsBumpmapLoaded ? PERMUTATION_NORMAL_MAP : 0));
 
-namespace std {
-	template<> struct hash<Vertex> {
-		size_t operator()(Vertex const& vertex) const {
-			return	((hash<glm::vec3>()(vertex.position) ^
-				(hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
-				(hash<glm::vec2>()(vertex.texcoord) << 1);
-		}
-	};
-}
+	uint32_t lightPermutation = common | (specializedShaders && tiledLighting ? PERMUTATION_TILED_LIGHTING : 0);
+	if (allLightCounts && specializedShaders && !tiledLighting && !lightVolumes)
+	{
+		for (uint32_t bucket = 0; bucket <= 32; bucket = bucket == 0 ? 1 : bucket << 1)
+			ProgramVariant("lPass", "Lvertex.vert", "Lfragment.frag", lightPermutation | (bucket << PERMUTATION_LIGHT_COUNT_SHIFT));
+	}
+	unsigned int program = ProgramVariant("lPass", "Lvertex.vert", "Lfragment.frag", lightPermutation | (lightCount << PERMUTATION_LIGHT_COUNT_SHIFT));
+	if (program != lPass)
+	{
+		lPass = program;
+		lightDataBaseLocation = glGetUniformLocation(lPass, "lightDataBase");
+		tileRangeBaseLocation = glGetUniformLocation(lPass, "tileRangeBase");
+		lightIndexBaseLocation = glGetUniformLocation(lPass, "lightIndexBase");
+	}
 
+	//debug views are only compiled when they are looked at
+	if (usingDebug || dPass == 0)
+	{
+		program = ProgramVariant("dPass", "Lvertex.vert", "debugShader.frag", common | (debugView << PERMUTATION_DEBUG_VIEW_SHIFT));
+		if (program != dPass)
+		{
+			dPass = program;
+			selectTextureLocation = glGetUniformLocation(dPass, "selectTexture");
+		}
+	}
 
+	//light volumes: esferas instanciadas com o fragment shader do L pass
+	if (lightVolumes && vPass == 0)
+	{
+		vPass = ProgramVariant("vPass", "lightVolume.vert", "Lfragment.frag", common | (specializedShaders ? PERMUTATION_LIGHT_VOLUME : 0));
+		volumeLightDataBaseLocation = glGetUniformLocation(vPass, "lightDataBase");
+	}
+}
 
+//near and far planes of the projection, also used to cull the tiled lights
+static const float zNear = 0.1f;
+static const float zFar = 100.0f;
 
-void GLWindowManager::LoadModel(const char* objName, bool randomColors = false)
+	//updates model-view-projection matrix based on current values for the eye, scale etc.
+void GLWindowManager::UpdateMVPMatrix()
 {
-	std::string warn, err;
-
-	srand(17);
-
-	if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, objName)) {
-		cout << warn + err << endl;
-		throw std::runtime_error(warn + err);
-	}
-
-	std::vector<glm::vec3> tangents;
-	std::vector<glm::vec3> bitangents;
-	std::vector<int> number_of_faces;
+	//construct model, view and projection matrices:
 
-	std::unordered_map<Vertex, uint32_t> unique_vertices = {};
-	std::vector<Vertex> aux_vertices = {};
-	indices.clear();
-	for (const auto& shape : shapes)
+	glm::mat4 Projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, zNear, zFar);
+	//the inverses go to the Camera block; they are only recomputed when the camera moves
+	if (Projection != projection)
 	{
-		for (const auto& index : shape.mesh.indices)
-		{
-			//o tinyobj loader garante que so todos triangulos
-			glm::vec3 pos = glm::vec3(attrib.vertices[index.vertex_index * 3], attrib.vertices[index.vertex_index * 3 + 1], attrib.vertices[index.vertex_index * 3 + 2]);
-			glm::vec3 color = glm::vec3(attrib.colors[index.vertex_index*3], attrib.colors[index.vertex_index*3 + 1], attrib.colors[index.vertex_index*3 + 2]);
-			glm::vec3 normal = glm::vec3(attrib.normals[index.normal_index*3], attrib.normals[index.normal_index*3 + 1], attrib.normals[index.normal_index*3 + 2]);
-			glm::vec2 texcoord = glm::vec2(attrib.texcoords[index.texcoord_index*2], attrib.texcoords[index.texcoord_index*2 + 1]);
-			Vertex vertex = {
-				//pos, color, normal, texcoord, tangents[index.vertex_index], bitangents[index.vertex_index]  //tangente e bitangente foram calculados acima
-				pos, color, normal, texcoord, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)   //tangente e bitangente so calculados abaixo
-			};
-
-			if (unique_vertices.count(vertex) == 0)
-			{
-				//se no h nenhum vrtice como este at agora, o adiciona a lista de vertices nicos
-				unique_vertices[vertex] = static_cast<uint32_t>(aux_vertices.size());
-				aux_vertices.push_back(vertex);
-			}
-
-			indices.push_back(unique_vertices[vertex]);
-		}
+		projection = Projection;
+		invProjection = glm::inverse(projection);
 	}
 
+	glm::mat4 View = glm::lookAt(eye, cameraTarget, up);
 
-	number_of_faces.resize(aux_vertices.size());
-	//calcula, para cada tringulo, a tangente e a bitangente
-	//ps: += tres para ir percorrendo a cada trs vrtices, ou seja, um tringulo.  certo que vrtices sero percorridos mais de uma vez, porm conto com o resultado no ser discrepante o suficiente para impactar
-	for (int i = 0; i < indices.size(); i += 3)
-	{
-		//adaptado de: http://www.opengl-tutorial.org/intermediate-tutorials/tutorial-13-normal-mapping/
+	model = glm::scale(glm::mat4(1.0f), glm::vec3(scale)) * glm::rotate(glm::mat4(1.0f), angle, glm::vec3(0.0f, 1.0f, 0.0f));
 
-		//cout << "triangle:" << i << endl;
-		// Shortcuts for vertices
-		Vertex v0 = aux_vertices[indices[i + 0]];
-		Vertex v1 = aux_vertices[indices[i + 1]];
-		Vertex v2 = aux_vertices[indices[i + 2]];
 
-		//edges of the triangle: position delta
-		glm::vec3 deltaPos1 = v1.position - v0.position;
-		glm::vec3 deltaPos2 = v2.position - v0.position;
+	
+	if (View != view)
+	{
+		view = View;
+		invView = glm::inverse(view);
+	}
+	modelView = View * model;
+	modelViewProjection = Projection * View * model;
 
-		// UV delta
-		glm::vec2 deltaUV1 = v1.texcoord - v0.texcoord;
-		glm::vec2 deltaUV2 = v2.texcoord - v0.texcoord;
+	//a inversa transposta da modelView
+	//primeiro inverte e depois tranpe?
+	ITmodelView = glm::transpose(glm::inverse(modelView));
+}
 
-		float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
-		glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y)*r;
-		glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x)*r;
+GLWindowManager::GLWindowManager()
+{
+	IsTextureLoaded = false;
+	IsBumpmapLoaded = false;
+	texturePath = "golfball/white.png";
+	bumpmapPath = "golfball/golfball.png";
+	indexCount = 0;
+	parallelObjLoading = true;
+	optimizeMesh = true;
+	vertexLayout = VERTEX_LAYOUT_FLOAT;
+	positionMin = glm::vec3(0.0f);
+	positionExtent = glm::vec3(1.0f);
+	view = projection = invView = invProjection = glm::mat4(1.0f);
+	compactGBuffer = false;
+	gDepth = 0;
+	tiledLighting = false;
+	tiledLightCount = 0;
+	clusteredLighting = false;
+	lightVolumes = false;
+	animateLights = false;
+	lightDataDirty = true;
+	lightDataBase = tileRangeBase = lightIndexBase = 0;
+	useProgramCache = true;
+	specializedShaders = true;
+	compressTextures = true;
+	captureInterval = 0;
+	qoiCaptures = false;
+	captureKeyDown = captureRequested = false;
+	programUniformsInitialized = false;
+	gPass = lPass = dPass = vPass = 0;
+	
+}
 
-		//adiciona valores para as mdias de cada vertice
-		number_of_faces[indices[i]] += 1;
-		number_of_faces[indices[i + 1]] += 1;
-		number_of_faces[indices[i + 2]] += 1;
+GLWindowManager::~GLWindowManager()
+{
+	//textureLoader joins its decoding threads
+	
+}
 
-		aux_vertices[indices[i]].tangent += tangent;
-		aux_vertices[indices[i + 1]].tangent += tangent;
-		aux_vertices[indices[i + 2]].tangent += tangent;
+void GLWindowManager::LoadModel(const char* objName, bool randomColors = false)
+{
+	std::string warn, err;
 
-		aux_vertices[indices[i]].bitangent += bitangent;
-		aux_vertices[indices[i + 1]].bitangent += bitangent;
-		aux_vertices[indices[i + 2]].bitangent += bitangent;
+	srand(17);
 
+	//warm start: the final buffers are already on disk
+	uint32_t cacheFlags = (randomColors ? MeshCache::RANDOM_COLORS : 0) | (optimizeMesh ? 0 : MeshCache::UNOPTIMIZED);
+	if (meshCache.Load(objName, cacheFlags, 17))
+	{
+		vertices.clear();
+		indices.clear();
+		indexCount = (unsigned int)meshCache.IndexCount();
+		printf("mesh cache hit for %s\n", objName);
+		printf("# of vertices infos  = %d\n", (int)meshCache.VertexFloatCount());
+		printf("# of triangles  = %d\n", (int)meshCache.IndexCount() / 3);
+		return;
 	}
 
-	//para cada tangente e bitangente, tira a media e normaliza
-	for (int i = 0; i < aux_vertices.size(); i++)
-	{
-		//cout << "vertex: " << i << ", number of faces: " << number_of_faces[i] << endl;
+	bool loaded = parallelObjLoading ? LoadObjParallel(&attrib, &shapes, &materials, &warn, &err, objName)
+		: tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, objName);
+	if (!loaded) {
+		cout << warn + err << endl;
+		throw std::runtime_error(warn + err);
+	}
 
-		aux_vertices[i].tangent = glm::vec3(aux_vertices[i].tangent.x / number_of_faces[i], aux_vertices[i].tangent.y / number_of_faces[i], aux_vertices[i].tangent.z / number_of_faces[i]);
-		aux_vertices[i].bitangent = glm::vec3(aux_vertices[i].bitangent.x / number_of_faces[i], aux_vertices[i].bitangent.y / number_of_faces[i], aux_vertices[i].bitangent.z / number_of_faces[i]);
+	//gathers every corner of every shape, then deduplicates them all at once
+	std::vector<Vertex> corners;
+	GatherCorners(attrib, shapes, corners);
+	size_t nCorners = corners.size();
 
-		glm::normalize(aux_vertices[i].tangent);
-		glm::normalize(aux_vertices[i].bitangent);
+	std::vector<Vertex> aux_vertices = {};
+	auto dedupStart = std::chrono::high_resolution_clock::now();
+	DeduplicateVertices(corners, aux_vertices, indices);
+	std::chrono::duration<double, std::milli> dedupTime = std::chrono::high_resolution_clock::now() - dedupStart;
+	printf("vertex dedup: %.2f ms for %d corners\n", dedupTime.count(), (int)nCorners);
+	std::vector<Vertex>().swap(corners);
 
-	}
 
+	auto tangentStart = std::chrono::high_resolution_clock::now();
+	size_t nDeduplicated = aux_vertices.size();
+	GenerateTangentFrames(aux_vertices, indices);
+	std::chrono::duration<double, std::milli> tangentTime = std::chrono::high_resolution_clock::now() - tangentStart;
+	printf("tangent frames: %.2f ms for %d triangles, %d vertices split on mirrored uvs\n", tangentTime.count(), (int)(indices.size() / 3), (int)(aux_vertices.size() - nDeduplicated));
 
 	//simply dump aux_vertices into vertex buffer:
 	//preenche vbo:
@@ -492,37 +557,32 @@ void GLWindowManager::LoadModel(const char* objName, bool randomColors = false)
 	printf("# of materials = %d\n", (int)materials.size());
 	printf("# of shapes    = %d\n", (int)shapes.size());
 
+	if (optimizeMesh)
+	{
+		auto optimizeStart = std::chrono::high_resolution_clock::now();
+		OptimizeMesh(vertices, 17, indices);
+		std::chrono::duration<double, std::milli> optimizeTime = std::chrono::high_resolution_clock::now() - optimizeStart;
+		printf("mesh optimization: %.2f ms\n", optimizeTime.count());
+	}
+
+	indexCount = (unsigned int)indices.size();
+	if (!MeshCache::Store(objName, cacheFlags, 17, vertices, indices))
+	{
+		cout << "Failed to write mesh cache for " << objName << endl;
+	}
 
 }
 
+//albedo texture, loaded by InitializeSceneInfo. Must be called before it
 void GLWindowManager::LoadTexture(const char* filepath)
 {
-	data = stbi_load(filepath, &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		IsTextureLoaded = true;
-
-	}
-	else
-	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-	
+	texturePath = filepath;
 }
 
+//normal map, loaded by InitializeSceneInfo. Must be called before it
 void GLWindowManager::LoadBumpmap(const char* filepath)
 {
-	bump_data = stbi_load(filepath, &width_bm, &height_bm, &nrChannels_bm, 0);
-	if (bump_data)
-	{
-		IsBumpmapLoaded = true;
-		
-	}
-	else
-	{
-		std::cout << "Failed to load texture" << std::endl;
-	}
-
+	bumpmapPath = filepath;
 }
 
 void GLWindowManager::randomPointInSphere(float *x, float *y, float *z, float radius)
@@ -538,16 +598,32 @@ void GLWindowManager::InitializeSceneInfo()
 	// reference: https://learnopengl.com/Getting-started/Hello-Window, https://learnopengl.com/Getting-started/Hello-Triangle
 
 	usingDebug = false;
+	selectTexture = 1;
 
 	//initialize opengl
 	glfwInit();
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (headless)
+	{
+		//the window is never shown, we only need its context and default framebuffer
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
 
 	//create glfw window
 	
 	window = glfwCreateWindow(screenWidth, screenHeight, "LearnOpenGL", NULL, NULL);
+	if (window == NULL && headless)
+	{
+		//no native context available (build farm without display/gpu): try EGL and then OSMesa, so we can run on llvmpipe
+		int fallbackApis[2] = { GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API };
+		for (int i = 0; i < 2 && window == NULL; i++)
+		{
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, fallbackApis[i]);
+			window = glfwCreateWindow(screenWidth, screenHeight, "LearnOpenGL", NULL, NULL);
+		}
+	}
 	if (window == NULL)
 	{
 		std::cout << "Failed to create GLFW window." << std::endl;
@@ -564,6 +640,9 @@ void GLWindowManager::InitializeSceneInfo()
 		exit(1);
 	}
 
+	profiler.Initialize();
+	frameCapture.Initialize();
+
 	//set viewport's size
 	glViewport(0, 0, screenWidth, screenHeight);
 	//set window's resize callback
@@ -573,83 +652,6 @@ void GLWindowManager::InitializeSceneInfo()
 	//enables depth testing
 	glEnable(GL_DEPTH_TEST);
 
-	// build and compile shaders ------------------
-
-	//shaders do G pass
-	unsigned int vertexShaderG;
-	BuildShader("Gvertex.vert", &vertexShaderG, GL_VERTEX_SHADER);
-	
-	unsigned int fragmentShaderG;
-	BuildShader("Gfragment.frag", &fragmentShaderG, GL_FRAGMENT_SHADER);
-
-	//shader do L pass
-	unsigned int vertexShaderL;
-	BuildShader("Lvertex.vert", &vertexShaderL, GL_VERTEX_SHADER);
-
-	unsigned int fragmentShaderL;
-	BuildShader("Lfragment.frag", &fragmentShaderL, GL_FRAGMENT_SHADER);
-
-	//shader Debug
-	unsigned int DebugL;
-	BuildShader("debugShader.frag", &DebugL, GL_FRAGMENT_SHADER);
-
-	// SHADER PROGRAM G PASS
-	int success;
-	char infoLog[512];
-
-	gPass = glCreateProgram();
-	//attach shader to program
-	glAttachShader(gPass, vertexShaderG);
-	glAttachShader(gPass, fragmentShaderG);
-	glLinkProgram(gPass);
-
-	//check for linking errors:
-	glGetProgramiv(gPass, GL_LINK_STATUS, &success);
-	if (!success) {
-		glGetProgramInfoLog(gPass, 512, NULL, infoLog);
-		std::cerr << "ERROR::SHADER::LINKING_ERROR\n" << infoLog << std::endl;
-	}
-	//glUseProgram(gPass);
-
-	// SHADER PROGRAM L PASS
-
-	lPass = glCreateProgram();
-	//attach shader to program
-	glAttachShader(lPass, vertexShaderL);
-	glAttachShader(lPass, fragmentShaderL);
-	glLinkProgram(lPass);
-
-	//check for linking errors:
-	glGetProgramiv(lPass, GL_LINK_STATUS, &success);
-	if (!success) {
-		glGetProgramInfoLog(lPass, 512, NULL, infoLog);
-		std::cerr << "ERROR::SHADER::LINKING_ERROR\n" << infoLog << std::endl;
-	}
-	//glUseProgram(gPass);
-
-	//SHADER PROGRAM DEBUG L PASS
-	dPass = glCreateProgram();
-	//attach shader to program
-	glAttachShader(dPass, vertexShaderL);
-	glAttachShader(dPass, DebugL);
-	glLinkProgram(dPass);
-
-	//check for linking errors:
-	glGetProgramiv(dPass, GL_LINK_STATUS, &success);
-	if (!success) {
-		glGetProgramInfoLog(dPass, 512, NULL, infoLog);
-		std::cerr << "ERROR::SHADER::LINKING_ERROR\n" << infoLog << std::endl;
-	}
-
-
-
-	//deleta os objetos shader, que j cumpriram sua funo
-	glDeleteShader(vertexShaderG);
-	glDeleteShader(fragmentShaderG);
-	glDeleteShader(vertexShaderL);
-	glDeleteShader(fragmentShaderL);
-
-	// END: build and compile shaders
 
 	//LOAD MODELS
 
@@ -721,15 +723,45 @@ void GLWindowManager::InitializeSceneInfo()
 	glGenBuffers(1, &VBO);
 
 	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	const void* vertexData = meshCache.IsLoaded() ? (const void*)meshCache.Vertices() : (const void*)vertices.data();
+	size_t vertexBytes = (meshCache.IsLoaded() ? meshCache.VertexFloatCount() : vertices.size()) * sizeof(float);
+	const void* indexData = meshCache.IsLoaded() ? (const void*)meshCache.Indices() : (const void*)indices.data();
+	size_t indexBytes = indexCount * sizeof(uint32_t);
+
+	if (tiledLighting || lightVolumes)
+	{
+		//the bounded lights are scattered around the mesh
+		const float* positions = (const float*)vertexData;
+		glm::vec3 boundsMin(FLT_MAX), boundsMax(-FLT_MAX);
+		for (size_t i = 0; i < vertexBytes / (17 * sizeof(float)); i++)
+		{
+			glm::vec3 p(positions[17 * i], positions[17 * i + 1], positions[17 * i + 2]);
+			boundsMin = glm::min(boundsMin, p);
+			boundsMax = glm::max(boundsMax, p);
+		}
+		GeneratePointLights(boundsMin, boundsMax);
+	}
+
+	std::vector<unsigned char> packedVertices;
+	if (vertexLayout != VERTEX_LAYOUT_FLOAT)
+	{
+		PackVertices((const float*)vertexData, vertexBytes / (17 * sizeof(float)), vertexLayout, packedVertices, positionMin, positionExtent);
+		cout << "vertex buffer: " << vertexBytes << " bytes as floats, " << packedVertices.size() << " bytes packed" << endl;
+		vertexData = packedVertices.data();
+		vertexBytes = packedVertices.size();
+	}
 	//aqui esto todas as infos: de posio do vrtice, cor e normais. Depois defino l em baixo como  a navegao por essas infos (glVertexAttribPointer)
-	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(vertices[0]), static_cast<void*>(vertices.data()), GL_STATIC_DRAW);
+	glBufferData(GL_ARRAY_BUFFER, vertexBytes, vertexData, GL_STATIC_DRAW);
 
 
 	//element buffer object:
 	//nesse caso, usamos um element buffer object pra poder informar a ordem de desenhar os tringulos, e no os vrtices mltiplas vezes
 	glGenBuffers(1, &EBO);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(indices[0]), static_cast<void*>(indices.data()), GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, indexData, GL_STATIC_DRAW);
+
+	//the data now lives on the gpu
+	meshCache.Release();
 
 
 	//reference: https://learnopengl.com/Advanced-Lighting/Deferred-Shading
@@ -739,117 +771,625 @@ void GLWindowManager::InitializeSceneInfo()
 
 	////texturas para o output da computao do geometry pass:
 
-	//position color buffer
-	glGenTextures(1, &gPosition);
-	glBindTexture(GL_TEXTURE_2D, gPosition);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, screenWidth, screenHeight, 0, GL_RGB, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0); //GL_COLOR_ATTACHMENT0
-
-	//normal color buffer
-	glGenTextures(1, &gNormal);
-	glBindTexture(GL_TEXTURE_2D, gNormal);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, screenWidth, screenHeight, 0, GL_RGB, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0); //GL_COLOR_ATTACHMENT1
-
-	//color + specular color buffer
-	glGenTextures(1, &gColorSpec);
-	glBindTexture(GL_TEXTURE_2D, gColorSpec);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, screenWidth, screenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gColorSpec, 0); //GL_COLOR_ATTACHMENT2
-
-	//tangent buffer
-	glGenTextures(1, &gTangent);
-	glBindTexture(GL_TEXTURE_2D, gTangent);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, screenWidth, screenHeight, 0, GL_RGB, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, gTangent, 0); //GL_COLOR_ATTACHMENT3
-
-	//bitangent buffer. Talvez no precise, dado que bitange pode ser calcula tendo-se a normal e a tangente, usando produto vetorial
-	glGenTextures(1, &gBitangent);
-	glBindTexture(GL_TEXTURE_2D, gBitangent);
-	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, screenWidth, screenHeight, 0, GL_RGB, GL_FLOAT, NULL);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, gBitangent, 0); //GL_COLOR_ATTACHMENT4
-
-	// - tell openGl which color attachments we'll use (of this framebuffer) for rendering
-	unsigned int attachments[5] = { GL_COLOR_ATTACHMENT0 , GL_COLOR_ATTACHMENT1 , GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4 };
-	glDrawBuffers(5, attachments);
-
-	//create and attach depth buffer(render buffer)
-	glGenRenderbuffers(1, &rboDepth);
-	glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
-	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, screenWidth, screenHeight);
-	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
+	if (compactGBuffer)
+	{
+		//normal: octahedral world space normal, two 16-bit channels
+		glGenTextures(1, &gNormal);
+		glBindTexture(GL_TEXTURE_2D, gNormal);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, screenWidth, screenHeight, 0, GL_RG, GL_UNSIGNED_SHORT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0);
+
+		//color + specular color buffer
+		glGenTextures(1, &gColorSpec);
+		glBindTexture(GL_TEXTURE_2D, gColorSpec);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, screenWidth, screenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gColorSpec, 0);
+
+		//Gfragment keeps its output locations: gPosition (0), gTangent (3) and gBitangent (4) go nowhere
+		unsigned int attachments[5] = { GL_NONE, GL_COLOR_ATTACHMENT1, GL_COLOR_ATTACHMENT2, GL_NONE, GL_NONE };
+		glDrawBuffers(5, attachments);
+
+		//depth (and stencil, for the light volumes) as a texture, sampled by the lighting pass to rebuild positions
+		glGenTextures(1, &gDepth);
+		glBindTexture(GL_TEXTURE_2D, gDepth);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH24_STENCIL8, screenWidth, screenHeight, 0, GL_DEPTH_STENCIL, GL_UNSIGNED_INT_24_8, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, gDepth, 0);
+
+		gPosition = gTangent = gBitangent = 0;
+	}
+	else
+	{
+		//position color buffer
+		glGenTextures(1, &gPosition);
+		glBindTexture(GL_TEXTURE_2D, gPosition);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, screenWidth, screenHeight, 0, GL_RGB, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gPosition, 0); //GL_COLOR_ATTACHMENT0
+
+		//normal color buffer
+		glGenTextures(1, &gNormal);
+		glBindTexture(GL_TEXTURE_2D, gNormal);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, screenWidth, screenHeight, 0, GL_RGB, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormal, 0); //GL_COLOR_ATTACHMENT1
+
+		//color + specular color buffer
+		glGenTextures(1, &gColorSpec);
+		glBindTexture(GL_TEXTURE_2D, gColorSpec);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, screenWidth, screenHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT2, GL_TEXTURE_2D, gColorSpec, 0); //GL_COLOR_ATTACHMENT2
+
+		//tangent buffer
+		glGenTextures(1, &gTangent);
+		glBindTexture(GL_TEXTURE_2D, gTangent);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, screenWidth, screenHeight, 0, GL_RGB, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT3, GL_TEXTURE_2D, gTangent, 0); //GL_COLOR_ATTACHMENT3
+
+		//bitangent buffer. Talvez no precise, dado que bitange pode ser calcula tendo-se a normal e a tangente, usando produto vetorial
+		glGenTextures(1, &gBitangent);
+		glBindTexture(GL_TEXTURE_2D, gBitangent);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, screenWidth, screenHeight, 0, GL_RGB, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT4, GL_TEXTURE_2D, gBitangent, 0); //GL_COLOR_ATTACHMENT4
+
+		// - tell openGl which color attachments we'll use (of this framebuffer) for rendering
+		unsigned int attachments[5] = { GL_COLOR_ATTACHMENT0 , GL_COLOR_ATTACHMENT1 , GL_COLOR_ATTACHMENT2, GL_COLOR_ATTACHMENT3, GL_COLOR_ATTACHMENT4 };
+		glDrawBuffers(5, attachments);
+
+		//create and attach depth buffer(render buffer). The stencil marks the pixels covered by geometry, for the light volumes
+		glGenRenderbuffers(1, &rboDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, rboDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, screenWidth, screenHeight);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, rboDepth);
+	}
 
 	// finally check if framebuffer is complete
 	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
 		std::cout << "Framebuffer not complete!" << std::endl;
 	glBindFramebuffer(GL_FRAMEBUFFER, 0); //unbind
 
-	glActiveTexture(GL_TEXTURE0);
-	//tex1 = loadTexture("stones/stones.jpg");
-	tex1 = loadTexture("golfball/white.png");
-	glActiveTexture(GL_TEXTURE1);
-	//tex2 = loadTexture("stones/stones_norm.jpg");
-	tex2 = loadTexture("golfball/golfball.png");
-	tex3 = loadTexture("golfball/Test-Pattern.jpg");
+	if (tiledLighting || lightVolumes)
+	{
+		//two RGBA32F texels per light, position + radius and color. Rewritten only when the lights move
+		lightDataStream.Initialize(pointLights.size() * 2 * sizeof(glm::vec4), GL_RGBA32F);
+
+		//the tile lists are rebuilt every frame, see UploadTileLists. The regions grow with the lists
+		int tileSize = clusteredLighting ? CLUSTER_TILE_SIZE : LIGHT_TILE_SIZE;
+		size_t cells = (size_t)((screenWidth + tileSize - 1) / tileSize) * ((screenHeight + tileSize - 1) / tileSize) * (clusteredLighting ? CLUSTER_SLICES : 1);
+		tileRangeStream.Initialize(cells * 2 * sizeof(uint32_t), GL_RG32UI);
+		lightIndexStream.Initialize(cells * 4 * sizeof(uint32_t), GL_R32UI);
+
+		if (clusteredLighting)
+		{
+			//the projection never changes, nor does the window size the g-buffer was made for
+			UpdateMVPMatrix();
+			clusterBinner.SetFrustum(projection, zNear, zFar, screenWidth, screenHeight);
+		}
+	}
+
+	if (lightVolumes)
+	{
+		//light accumulation target, with its own copy of the g-buffer depth and stencil so gDepth is never sampled
+		//while attached
+		glGenFramebuffers(1, &lightAccumBuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, lightAccumBuffer);
+
+		glGenTextures(1, &lightAccumTexture);
+		glBindTexture(GL_TEXTURE_2D, lightAccumTexture);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, screenWidth, screenHeight, 0, GL_RGBA, GL_FLOAT, NULL);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, lightAccumTexture, 0);
+
+		glGenRenderbuffers(1, &lightAccumDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, lightAccumDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, screenWidth, screenHeight);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, lightAccumDepth);
+
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			std::cout << "Light accumulation framebuffer not complete!" << std::endl;
+		glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	}
+
+	//texturas: decodificadas em threads e enviadas aos poucos pelo render loop. At l ficam com uma cor s; a do
+	//bumpmap  a normal (0, 0, 1), que d o mesmo resultado que no usar mapeamento de normais
+	static const unsigned char white[4] = { 255, 255, 255, 255 };
+	static const unsigned char flatNormal[4] = { 128, 128, 255, 255 };
+	static const unsigned char grey[4] = { 128, 128, 128, 255 };
+	//comprimidas em blocos: BC5 (core) nos bumpmaps, BC1/BC3 nas cores se o driver tiver S3TC
+	uint32_t normalMapFlags = TextureContainer::NORMAL_MAP | (compressTextures ? TextureContainer::BLOCK_COMPRESSED : 0);
+	uint32_t colorFlags = compressTextures && TextureLoader::SupportsS3TC() ? TextureContainer::BLOCK_COMPRESSED : 0;
+	textureLoader.Initialize();
+	tex1 = textureLoader.Load(texturePath.c_str(), white, colorFlags);
+	tex2 = textureLoader.Load(bumpmapPath.c_str(), flatNormal, normalMapFlags);
+	tex3 = textureLoader.Load("golfball/Test-Pattern.jpg", grey, colorFlags);
+	//until the loader reports them failed (HandleFailedTextures)
+	IsTextureLoaded = !texturePath.empty();
+	IsBumpmapLoaded = !bumpmapPath.empty();
+	if (headless)
+	{
+		//benchmark frames should not include texture uploads
+		textureLoader.Finish();
+		HandleFailedTextures();
+	}
 	
-	IsTextureLoaded = true;
-	IsBumpmapLoaded = true;
 	tex3active = false;
 
-	//o buffer  composto de: 
-	//coordenadas(3) + cores(3) + normais(3) + coord_texturas(2) + tangentes(3) + bitangente(3)
+	if (vertexLayout == VERTEX_LAYOUT_FLOAT)
+	{
+		//o buffer  composto de: 
+		//coordenadas(3) + cores(3) + normais(3) + coord_texturas(2) + tangentes(3) + bitangente(3)
 
-	////inform openGL about our vertex attributes
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)0);
-	glEnableVertexAttribArray(0);
+		////inform openGL about our vertex attributes
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)0);
+		glEnableVertexAttribArray(0);
 
-	//inform openGL about our color attributes
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)(3*sizeof(float)));
-	glEnableVertexAttribArray(1);
+		//inform openGL about our color attributes
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)(3*sizeof(float)));
+		glEnableVertexAttribArray(1);
 
-	//inform openGL about our normal attributes
-	glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)(6 * sizeof(float)));
-	glEnableVertexAttribArray(2);
+		//inform openGL about our normal attributes
+		glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)(6 * sizeof(float)));
+		glEnableVertexAttribArray(2);
 
-	//inform openGL about our texture coordinate attributes
-	glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)(9 * sizeof(float)));
-	glEnableVertexAttribArray(3);
+		//inform openGL about our texture coordinate attributes
+		glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)(9 * sizeof(float)));
+		glEnableVertexAttribArray(3);
 
-	//inform openGL about our tangent attributes
-	glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)(11 * sizeof(float)));
-	glEnableVertexAttribArray(4);
+		//inform openGL about our tangent attributes
+		glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)(11 * sizeof(float)));
+		glEnableVertexAttribArray(4);
 
-	//inform openGL about our bi-tangent attributes
-	glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)(14 * sizeof(float)));
-	glEnableVertexAttribArray(5);
+		//inform openGL about our bi-tangent attributes
+		glVertexAttribPointer(5, 3, GL_FLOAT, GL_FALSE, 17 * sizeof(float), (void*)(14 * sizeof(float)));
+		glEnableVertexAttribArray(5);
+	}
+	else
+	{
+		//packed: the color (location 1) and the bitangent (location 5) are not stored; the shader rebuilds the bitangent
+		PackedVertexFormat format = GetPackedVertexFormat(vertexLayout);
+
+		if (vertexLayout == VERTEX_LAYOUT_PACKED16)
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, format.stride, (void*)(size_t)format.positionOffset);
+		else
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, format.stride, (void*)(size_t)format.positionOffset);
+		glEnableVertexAttribArray(0);
+
+		glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, format.stride, (void*)(size_t)format.normalOffset);
+		glEnableVertexAttribArray(2);
+
+		glVertexAttribPointer(3, 2, GL_HALF_FLOAT, GL_FALSE, format.stride, (void*)(size_t)format.texcoordOffset);
+		glEnableVertexAttribArray(3);
+
+		glVertexAttribPointer(4, 4, GL_INT_2_10_10_10_REV, GL_TRUE, format.stride, (void*)(size_t)format.tangentOffset);
+		glEnableVertexAttribArray(4);
+	}
 
 
 	//unbind VAO
 	glBindVertexArray(0);
 
+	// build and compile shaders ------------------
+	//after the textures and buffers: the permutations depend on what was loaded
+	auto shaderStart = std::chrono::high_resolution_clock::now();
+	programCache.Initialize(useProgramCache);
+	cachedPrograms = compiledPrograms = 0;
+
+	SelectShaderVariants(true);
+
+	std::chrono::duration<double, std::milli> shaderTime = std::chrono::high_resolution_clock::now() - shaderStart;
+	cout << "shader programs: " << shaderTime.count() << " ms, " << cachedPrograms << " from the program cache, "
+		<< compiledPrograms << " compiled" << (programCache.IsEnabled() ? "" : " (program cache disabled)")
+		<< (specializedShaders ? "" : ", generic shaders") << endl;
+	// END: build and compile shaders
+
+	InitializeProgramUniforms();
+
 	cout << gPass << endl;
 }
 
+//uniform buffer binding points of the Camera and Lights blocks
+static const unsigned int CAMERA_BLOCK_BINDING = 0;
+static const unsigned int LIGHTS_BLOCK_BINDING = 1;
+
+//creates the uniform buffers, binds the blocks of every program to them and sets, once, every uniform that does not
+//change after InitializeSceneInfo. Samplers always use the same texture units: 0 to 5 for the g-buffer (gPosition,
+//gNormal, gColorSpec, gTangent, gBitangent, gDepth) and 6 to 8 for the light texture buffers
+void GLWindowManager::InitializeProgramUniforms()
+{
+	glGenBuffers(1, &cameraUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BLOCK_BINDING, cameraUBO);
+
+	glGenBuffers(1, &lightsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, lightsUBO);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LightsBlock), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LIGHTS_BLOCK_BINDING, lightsUBO);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	cameraUploaded = false;
+	lightsDirty = true;
+
+	for (auto& variant : programVariants)
+		SetupProgram(variant.second);
+	programUniformsInitialized = true;
+}
+
+//binds the uniform blocks of a program and sets its fixed uniforms. Uniforms a program does not have resolve to -1,
+//which glUniform ignores, so every program gets the same calls
+void GLWindowManager::SetupProgram(unsigned int program)
+{
+	unsigned int cameraIndex = glGetUniformBlockIndex(program, "Camera");
+	if (cameraIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, cameraIndex, CAMERA_BLOCK_BINDING);
+	unsigned int lightsIndex = glGetUniformBlockIndex(program, "Lights");
+	if (lightsIndex != GL_INVALID_INDEX)
+		glUniformBlockBinding(program, lightsIndex, LIGHTS_BLOCK_BINDING);
+
+	int tileSize = clusteredLighting ? CLUSTER_TILE_SIZE : LIGHT_TILE_SIZE;
+	int currentProgram = 0;
+	glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgram);
+	glUseProgram(program);
+	glUniform1i(glGetUniformLocation(program, "gPosition"), 0);
+	glUniform1i(glGetUniformLocation(program, "gNormal"), 1);
+	glUniform1i(glGetUniformLocation(program, "gColorSpec"), 2);
+	glUniform1i(glGetUniformLocation(program, "gTangent"), 3);
+	glUniform1i(glGetUniformLocation(program, "gBitangent"), 4);
+	glUniform1i(glGetUniformLocation(program, "gDepth"), 5);
+	glUniform1i(glGetUniformLocation(program, "lightData"), 6);
+	glUniform1i(glGetUniformLocation(program, "tileRanges"), 7);
+	glUniform1i(glGetUniformLocation(program, "lightIndices"), 8);
+
+	//features of the generic shaders
+	glUniform1i(glGetUniformLocation(program, "compactGBuffer"), compactGBuffer);
+	glUniform1i(glGetUniformLocation(program, "normalMapping"), IsBumpmapLoaded);
+	glUniform1i(glGetUniformLocation(program, "tiledLighting"), tiledLighting && program != vPass);
+	glUniform1i(glGetUniformLocation(program, "lightVolume"), program == vPass);
+
+	glUniform3f(glGetUniformLocation(program, "Ka"), 0.5f, 0.5f, 0.5f);
+	glUniform3f(glGetUniformLocation(program, "Ks"), 1.0f, 1.f, 1.f);
+	glUniform1f(glGetUniformLocation(program, "Mshi"), 100.0f);
+
+	glUniform1i(glGetUniformLocation(program, "tileSize"), tileSize);
+	glUniform1i(glGetUniformLocation(program, "tilesX"), (screenWidth + tileSize - 1) / tileSize);
+	glUniform1i(glGetUniformLocation(program, "tilesY"), (screenHeight + tileSize - 1) / tileSize);
+	glUniform1i(glGetUniformLocation(program, "clusterSlices"), clusteredLighting ? CLUSTER_SLICES : 0);
+	glUniform1f(glGetUniformLocation(program, "clusterNear"), zNear);
+	glUniform1f(glGetUniformLocation(program, "clusterScale"), clusterBinner.SliceScale());
+	glUniform2f(glGetUniformLocation(program, "screenSize"), (float)screenWidth, (float)screenHeight);
+
+	glUniform1i(glGetUniformLocation(program, "texture_data"), 0);
+	glUniform1i(glGetUniformLocation(program, "bumpmap"), 1);
+	//vertex layout and position dequantization
+	glUniform1i(glGetUniformLocation(program, "packedVertices"), vertexLayout != VERTEX_LAYOUT_FLOAT);
+	glUniform3fv(glGetUniformLocation(program, "positionMin"), 1, glm::value_ptr(positionMin));
+	glUniform3fv(glGetUniformLocation(program, "positionExtent"), 1, glm::value_ptr(positionExtent));
+	glUseProgram(currentProgram);
+}
+
+//refreshes the Camera and Lights uniform buffers, uploading only the blocks that changed since the last frame
+void GLWindowManager::UpdateUniformBuffers()
+{
+	CameraBlock camera;
+	camera.mvp = modelViewProjection;
+	camera.mv = modelView;
+	camera.v = view;
+	camera.m = model;
+	camera.ITmv = ITmodelView;
+	camera.vp = projection * view;
+	camera.invProjection = invProjection;
+	camera.invView = invView;
+	camera.eye = eye;
+	camera.padding = 0.0f;
+	if (!cameraUploaded || memcmp(&camera, &cameraBlock, sizeof(CameraBlock)) != 0)
+	{
+		cameraBlock = camera;
+		glBindBuffer(GL_UNIFORM_BUFFER, cameraUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), &cameraBlock);
+		cameraUploaded = true;
+	}
+
+	//light volumes: the full screen pass only draws the ambient term
+	int activeLights = lightVolumes ? 0 : nLights;
+	if (lightsDirty || lightsBlock.nLights != activeLights)
+	{
+		for (int i = 0; i < 32; i++)
+		{
+			lightsBlock.positions[i] = glm::vec4(lights[3 * i], lights[3 * i + 1], lights[3 * i + 2], 1.0f);
+			lightsBlock.colors[i] = glm::vec4(lightsColors[3 * i], lightsColors[3 * i + 1], lightsColors[3 * i + 2], 1.0f);
+		}
+		lightsBlock.nLights = activeLights;
+		lightsBlock.padding[0] = lightsBlock.padding[1] = lightsBlock.padding[2] = 0;
+		glBindBuffer(GL_UNIFORM_BUFFER, lightsUBO);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightsBlock), &lightsBlock);
+		lightsDirty = false;
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 // reference: https://learnopengl.com/Getting-started/Hello-Window, https://learnopengl.com/Getting-started/Hello-Triangle
 	
-//will start the render loop and finish executing only when the window is closed
+//selects between LoadObjParallel (default) and the single threaded tinyobj::LoadObj. Both give the same result
+void GLWindowManager::SetParallelObjLoading(bool parallel)
+{
+	parallelObjLoading = parallel;
+}
+
+//LoadModel reorders the buffers with OptimizeMesh unless disabled. The cache keeps optimized and unoptimized meshes apart
+void GLWindowManager::SetMeshOptimization(bool optimize)
+{
+	optimizeMesh = optimize;
+}
+
+//selects the vertex buffer layout (see VertexLayout). Must be called before InitializeSceneInfo
+void GLWindowManager::SetVertexLayout(VertexLayout layout)
+{
+	vertexLayout = layout;
+}
+
+//selects the compact G-buffer (see compactGBuffer). Must be called before InitializeSceneInfo
+void GLWindowManager::SetCompactGBuffer(bool compact)
+{
+	compactGBuffer = compact;
+}
+
+//replaces the point light lighting (32 unbounded lights) with nLights bounded lights culled per screen tile
+//must be called before InitializeSceneInfo
+void GLWindowManager::SetTiledLighting(int nLights)
+{
+	tiledLighting = true;
+	tiledLightCount = nLights;
+}
+
+//same as SetTiledLighting, but the lights are binned into clusters (see ClusteredLightBinner)
+//must be called before InitializeSceneInfo
+void GLWindowManager::SetClusteredLighting(int nLights)
+{
+	SetTiledLighting(nLights);
+	clusteredLighting = true;
+}
+
+//same bounded lights as SetTiledLighting, drawn as light volumes (see renderLightVolumes)
+//must be called before InitializeSceneInfo
+void GLWindowManager::SetLightVolumes(int nLights)
+{
+	lightVolumes = true;
+	tiledLightCount = nLights;
+}
+
+//scatters tiledLightCount lights with random colors in the mesh bounds, grown by half their size on each side.
+//The radius shrinks with the light count, so the number of lights reaching a pixel stays about the same
+void GLWindowManager::GeneratePointLights(glm::vec3 boundsMin, glm::vec3 boundsMax)
+{
+	glm::vec3 center = (boundsMin + boundsMax) * 0.5f;
+	glm::vec3 spread = boundsMax - boundsMin;
+	float diagonal = glm::length(boundsMax - boundsMin);
+	float radius = diagonal * max(0.1f, 0.5f / cbrt((float)max(tiledLightCount, 1) / 32.0f));
+
+	std::default_random_engine generator(17);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> colorDistribution(0.0f, 1.0f);
+	pointLights.resize(tiledLightCount);
+	for (PointLight& light : pointLights)
+	{
+		light.position = center + spread * glm::vec3(unit(generator), unit(generator), unit(generator));
+		light.radius = radius;
+		light.color = glm::vec3(colorDistribution(generator), colorDistribution(generator), colorDistribution(generator));
+	}
+	lightCenter = center;
+	lightOrigins.resize(pointLights.size());
+	for (size_t i = 0; i < pointLights.size(); i++)
+		lightOrigins[i] = pointLights[i].position;
+	cout << tiledLightCount << " tiled lights, radius " << radius << endl;
+}
+
+//streams this frame's tile lists into their rings and points lPass (which must be bound) at them
+void GLWindowManager::UploadTileLists()
+{
+	//a texture buffer may not be empty
+	if (tileLists.lightIndices.empty())
+		tileLists.lightIndices.push_back(0);
+
+	size_t rangeBytes = tileLists.tileRanges.size() * sizeof(uint32_t);
+	memcpy(tileRangeStream.Map(rangeBytes), tileLists.tileRanges.data(), rangeBytes);
+	tileRangeBase = (int)(tileRangeStream.Unmap() / (2 * sizeof(uint32_t)));
+
+	size_t indexBytes = tileLists.lightIndices.size() * sizeof(uint32_t);
+	memcpy(lightIndexStream.Map(indexBytes), tileLists.lightIndices.data(), indexBytes);
+	lightIndexBase = (int)(lightIndexStream.Unmap() / sizeof(uint32_t));
+
+	glUniform1i(tileRangeBaseLocation, tileRangeBase);
+	glUniform1i(lightIndexBaseLocation, lightIndexBase);
+}
+
+//streams the light data when the lights moved (or were never sent) and points lPass (which must be bound) at it
+void GLWindowManager::StreamLightData()
+{
+	if (lightDataDirty)
+	{
+		glm::vec4* lightData = (glm::vec4*)lightDataStream.Map(pointLights.size() * 2 * sizeof(glm::vec4));
+		for (size_t i = 0; i < pointLights.size(); i++)
+		{
+			lightData[2 * i] = glm::vec4(pointLights[i].position, pointLights[i].radius);
+			lightData[2 * i + 1] = glm::vec4(pointLights[i].color, 0.0f);
+		}
+		lightDataBase = (int)(lightDataStream.Unmap() / sizeof(glm::vec4));
+		lightDataDirty = false;
+	}
+	glUniform1i(lightDataBaseLocation, lightDataBase);
+}
+
+//fences whatever the streams received this frame; call once the lighting pass has been issued
+void GLWindowManager::FenceStreams()
+{
+	lightDataStream.Fence();
+	tileRangeStream.Fence();
+	lightIndexStream.Fence();
+	volumeInstanceStream.Fence();
+}
+
+//moves every light along its circle around the vertical axis through lightCenter. Angular speeds vary per light
+void GLWindowManager::AnimatePointLights(float time)
+{
+	for (size_t i = 0; i < pointLights.size(); i++)
+	{
+		float phase = time * (0.25f + 0.75f * (float)(i % 16) / 16.0f);
+		float c = cos(phase), s = sin(phase);
+		glm::vec3 offset = lightOrigins[i] - lightCenter;
+		pointLights[i].position = lightCenter + glm::vec3(c * offset.x + s * offset.z, offset.y, c * offset.z - s * offset.x);
+	}
+	lightDataDirty = true;
+}
+
+//specialized == false builds only the generic shaders, to compare against the specialized permutations.
+//must be called before InitializeSceneInfo
+void GLWindowManager::SetSpecializedShaders(bool specialized)
+{
+	specializedShaders = specialized;
+}
+
+//block compressed textures (BC1/BC3 color, BC5 normal maps); with compress == false they are uploaded as they are decoded.
+//must be called before InitializeSceneInfo
+void GLWindowManager::SetTextureCompression(bool compress)
+{
+	compressTextures = compress;
+}
+
+//program binary cache: with cache == false every program is compiled from source, and nothing is written.
+//must be called before InitializeSceneInfo
+void GLWindowManager::SetProgramCache(bool cache)
+{
+	useProgramCache = cache;
+}
+
+//animated lights: the bounded lights (tiled, clustered or light volumes) move every frame
+void GLWindowManager::SetAnimatedLights(bool animate)
+{
+	animateLights = animate;
+}
+
+//frame capture: with nFrames > 0 every nFrames-th frame is captured (1: every frame, a continuous sequence)
+void GLWindowManager::SetCaptureInterval(int nFrames)
+{
+	captureInterval = max(nFrames, 0);
+}
+
+//captures of the sequence are written as qoi, which keeps pace with far higher frame rates than png. --qoi-to-png
+//converts them afterwards
+void GLWindowManager::SetQoiCaptures(bool qoi)
+{
+	qoiCaptures = qoi;
+}
+
+//queues the back buffer, at the size of the framebuffer, to be written asynchronously
+void GLWindowManager::CaptureFrame(int frame)
+{
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	if (width <= 0 || height <= 0)
+		return;
+
+	if (captureRequested)
+	{
+		frameCapture.Capture(width, height, "output.png");
+		captureRequested = false;
+	}
+	else
+	{
+		char path[32];
+		snprintf(path, sizeof(path), qoiCaptures ? "capture_%05d.qoi" : "capture_%05d.png", frame);
+		frameCapture.Capture(width, height, path);
+	}
+}
+
+//headless mode: no visible window and no input. StartRenderLoop renders nFrames along a scripted camera path and returns
+//must be called before InitializeSceneInfo
+void GLWindowManager::SetHeadless(int nFrames)
+{
+	headless = true;
+	benchmarkFrames = nFrames;
+}
+
+//scripted camera path for headless runs: one full orbit around the target, bobbing up and down, over benchmarkFrames
+void GLWindowManager::UpdateScriptedCamera(int frame)
+{
+	float t = float(frame) / float(max(benchmarkFrames, 1));
+	float theta = t * 2.0f * glm::pi<float>();
+	float radius = 10.0f;
+
+	eye = cameraTarget + glm::vec3(radius * sin(theta), 2.0f * sin(2.0f * theta), radius * cos(theta));
+}
+
+//prints per-frame timings and a summary, and dumps them to frametimes.csv
+void GLWindowManager::ReportFrameTimes()
+{
+	if (frameTimes.empty())
+		return;
+
+	std::ofstream csv("frametimes.csv");
+	csv << "frame,ms" << endl;
+	double total = 0.0, minTime = frameTimes[0], maxTime = frameTimes[0];
+	for (size_t i = 0; i < frameTimes.size(); i++)
+	{
+		csv << i << "," << frameTimes[i] << endl;
+		cout << "frame " << i << ": " << frameTimes[i] << " ms" << endl;
+		total += frameTimes[i];
+		minTime = min(minTime, frameTimes[i]);
+		maxTime = max(maxTime, frameTimes[i]);
+	}
+	csv.close();
+
+	cout << "frames: " << frameTimes.size() << ", avg: " << total / frameTimes.size() << " ms, min: " << minTime << " ms, max: " << maxTime << " ms" << endl;
+}
+
+//will start the render loop and finish executing only when the window is closed (or, in headless mode, after benchmarkFrames frames)
 void GLWindowManager::StartRenderLoop()
 {
 	//the render loop
 	cout << gPass << endl;
+	int frame = 0;
+	frameTimes.clear();
 	while (!glfwWindowShouldClose(window))
 	{
-		processInput(window);
+		if (headless && frame >= benchmarkFrames)
+		{
+			break;
+		}
+		double frameStart = glfwGetTime();
+		profiler.BeginFrame();
+
+		profiler.BeginCPU(FrameProfiler::CPU_PROCESS_INPUT);
+		if (headless)
+		{
+			UpdateScriptedCamera(frame);
+		}
+		else
+		{
+			processInput(window);
+		}
+		profiler.EndCPU(FrameProfiler::CPU_PROCESS_INPUT);
+
+		//textures that finished decoding, captures whose readback finished
+		textureLoader.Update();
+		HandleFailedTextures();
+		frameCapture.Update();
+
+		//light count and debug view may have changed
+		SelectShaderVariants();
 
 		//clear pixels
 		glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
@@ -857,8 +1397,18 @@ void GLWindowManager::StartRenderLoop()
 
 		//gBuffer render:
 		{
+			profiler.BeginGPU(FrameProfiler::GPU_GEOMETRY_PASS);
 			glBindFramebuffer(GL_FRAMEBUFFER, gBuffer);
-			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+			if (lightVolumes)
+			{
+				//stencil = 1 wherever there is geometry
+				glEnable(GL_STENCIL_TEST);
+				glStencilFunc(GL_ALWAYS, 1, 0xFF);
+				glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+				glStencilMask(0xFF);
+			}
 
 			glUseProgram(gPass);
 
@@ -870,31 +1420,13 @@ void GLWindowManager::StartRenderLoop()
 			glBindVertexArray(VAO); //bind
 
 			//atualiza matriz model-view-projection
+			profiler.BeginCPU(FrameProfiler::CPU_UPDATE_MVP);
 			UpdateMVPMatrix();
-			//passa as matrizes mvp pra placa
-			int mvpParam = glGetUniformLocation(gPass, "mvp");
-			glUniformMatrix4fv(mvpParam, 1, GL_FALSE, glm::value_ptr(modelViewProjection));
-			int mvParam = glGetUniformLocation(gPass, "mv");
-			glUniformMatrix4fv(mvParam, 1, GL_FALSE, glm::value_ptr(modelView));
-			int vParam = glGetUniformLocation(gPass, "v");
-			glUniformMatrix4fv(vParam, 1, GL_FALSE, glm::value_ptr(view));
-
-			// uma mat3?
-			int ITmvParam = glGetUniformLocation(gPass, "ITmv");
-			glUniformMatrix4fv(ITmvParam, 1, GL_FALSE, glm::value_ptr(ITmodelView));
-
-			//passa eye, light positions e nLights
-			int eyeParam = glGetUniformLocation(gPass, "eye");
-			glUniform3f(eyeParam, eye.x, eye.y, eye.z);
-
-			//passa texturas:
-
-			glUniform1i(glGetUniformLocation(gPass, "texture_data"), 0);
-			glUniform1i(glGetUniformLocation(gPass, "bumpmap"), 1);
-
-			//glUniform3f(glGetUniformLocation(gPass, "Ka"), materials[0].ambient[0], materials[0].ambient[1], materials[0].ambient[2]);
-			//glUniform3f(glGetUniformLocation(gPass, "Ks"), materials[0].specular[0], materials[0].specular[1], materials[0].specular[2]);
-			//glUniform1f(glGetUniformLocation(gPass, "Mshi"), 128.0f);
+			profiler.EndCPU(FrameProfiler::CPU_UPDATE_MVP);
+			//passa as matrizes pra placa (uniform buffer compartilhado por todos os passes)
+			profiler.BeginCPU(FrameProfiler::CPU_UNIFORM_UPLOAD);
+			UpdateUniformBuffers();
+			profiler.EndCPU(FrameProfiler::CPU_UNIFORM_UPLOAD);
 
 			glActiveTexture(GL_TEXTURE0);
 			if (tex3active)
@@ -911,30 +1443,26 @@ void GLWindowManager::StartRenderLoop()
 			
 
 			//devo passar indices.size, que  a qtd de indices usados (3 para cada triangulo)
-			glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+			glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
 
 			//glDrawArrays(GL_TRIANGLES, 0, vertices.size());
 			glBindVertexArray(0); //unbind
+			glDisable(GL_STENCIL_TEST);
 
 			glBindFramebuffer(GL_FRAMEBUFFER, 0); //unbind
+			profiler.EndGPU(FrameProfiler::GPU_GEOMETRY_PASS);
 		}
 
 		//lighting pass:
 		{
+			profiler.BeginGPU(FrameProfiler::GPU_LIGHTING_PASS);
+			profiler.BeginCPU(FrameProfiler::CPU_UNIFORM_UPLOAD);
 			if (usingDebug)
 			{
 				glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 				glUseProgram(dPass);
-
-				glUniform1i(glGetUniformLocation(dPass, "gPosition"), 0);
-				glUniform1i(glGetUniformLocation(dPass, "gNormal"), 1);
-				glUniform1i(glGetUniformLocation(dPass, "gColorSpec"), 2);
-				glUniform1i(glGetUniformLocation(dPass, "gTangent"), 3);
-				glUniform1i(glGetUniformLocation(dPass, "gBitangent"), 4);
-
-				int selectParam = glGetUniformLocation(dPass, "selectTexture");
-				glUniform1i(selectParam, selectTexture);
+				glUniform1i(selectTextureLocation, selectTexture);
 
 				//passa resultados do geometry pass como texturas
 				glActiveTexture(GL_TEXTURE0);
@@ -952,6 +1480,9 @@ void GLWindowManager::StartRenderLoop()
 				glActiveTexture(GL_TEXTURE4);
 				glBindTexture(GL_TEXTURE_2D, gBitangent);
 
+				glActiveTexture(GL_TEXTURE5);
+				glBindTexture(GL_TEXTURE_2D, gDepth);
+
 			}
 			else
 			{
@@ -960,30 +1491,32 @@ void GLWindowManager::StartRenderLoop()
 
 				glUseProgram(lPass);
 
-				glUniform1i(glGetUniformLocation(lPass, "gPosition"), 0);
-				glUniform1i(glGetUniformLocation(lPass, "gNormal"), 1);
-				glUniform1i(glGetUniformLocation(lPass, "gColorSpec"), 2);
-				glUniform1i(glGetUniformLocation(lPass, "gTangent"), 3);
-				glUniform1i(glGetUniformLocation(lPass, "gBitangent"), 4);
-
-				int eyeParam = glGetUniformLocation(lPass, "eye");
-				glUniform3f(eyeParam, eye.x, eye.y, eye.z);
-
-				int nLightsParam = glGetUniformLocation(lPass, "nLights");
-				glUniform1i(nLightsParam, nLights);
-
-				int lightParam = glGetUniformLocation(lPass, "lightPositions");
-				glUniform3fv(lightParam, 32, &lights[0]);
-
-				int lightColorParam = glGetUniformLocation(lPass, "lightColors");
-				glUniform3fv(lightColorParam, 32, &lightsColors[0]);
-
-				glUniform3f(glGetUniformLocation(lPass, "Ka"), 0.5f, 0.5f, 0.5f);
-				glUniform3f(glGetUniformLocation(lPass, "Ks"), 1.0f, 1.f, 1.f);
-				glUniform1f(glGetUniformLocation(lPass, "Mshi"), 100.0f);
-
-				int mParam = glGetUniformLocation(lPass, "m");
-				glUniformMatrix4fv(mParam, 1, GL_FALSE, glm::value_ptr(model));
+				if (tiledLighting || lightVolumes)
+				{
+					profiler.EndCPU(FrameProfiler::CPU_UNIFORM_UPLOAD);
+					profiler.BeginCPU(FrameProfiler::CPU_LIGHT_BINNING);
+					if (animateLights)
+						AnimatePointLights(headless ? frame / 60.0f : (float)glfwGetTime());
+					if (clusteredLighting)
+						clusterBinner.Bin(pointLights, view, tileLists);
+					else if (tiledLighting)
+						BinLightsInTiles(pointLights, view, projection, zNear, zFar, screenWidth, screenHeight, tileLists);
+					profiler.EndCPU(FrameProfiler::CPU_LIGHT_BINNING);
+					profiler.BeginCPU(FrameProfiler::CPU_UNIFORM_UPLOAD);
+					StreamLightData();
+				}
+
+				if (tiledLighting)
+				{
+					UploadTileLists();
+
+					glActiveTexture(GL_TEXTURE6);
+					glBindTexture(GL_TEXTURE_BUFFER, lightDataStream.Texture());
+					glActiveTexture(GL_TEXTURE7);
+					glBindTexture(GL_TEXTURE_BUFFER, tileRangeStream.Texture());
+					glActiveTexture(GL_TEXTURE8);
+					glBindTexture(GL_TEXTURE_BUFFER, lightIndexStream.Texture());
+				}
 
 				//passa resultados do geometry pass como texturas
 				glActiveTexture(GL_TEXTURE0);
@@ -1000,14 +1533,56 @@ void GLWindowManager::StartRenderLoop()
 
 				glActiveTexture(GL_TEXTURE4);
 				glBindTexture(GL_TEXTURE_2D, gBitangent);
+
+				glActiveTexture(GL_TEXTURE5);
+				glBindTexture(GL_TEXTURE_2D, gDepth);
 			}
+			profiler.EndCPU(FrameProfiler::CPU_UNIFORM_UPLOAD);
 
 			//render a quad, with the textures
-			renderQuad();
+			if (lightVolumes && !usingDebug)
+			{
+				renderLightVolumes();
+			}
+			else
+			{
+				renderQuad();
+			}
+			FenceStreams();
+			profiler.EndGPU(FrameProfiler::GPU_LIGHTING_PASS);
 		}
 
+		if (captureRequested || (captureInterval > 0 && frame % captureInterval == 0))
+		{
+			CaptureFrame(frame);
+		}
+
+		profiler.BeginGPU(FrameProfiler::GPU_PRESENT);
 		glfwSwapBuffers(window);
+		profiler.EndGPU(FrameProfiler::GPU_PRESENT);
 		glfwPollEvents();
+
+		if (headless)
+		{
+			//wait for the gpu so the timing covers the whole frame, not just command submission
+			glFinish();
+		}
+		frameTimes.push_back((glfwGetTime() - frameStart) * 1000.0);
+		profiler.EndFrame();
+		frame++;
+	}
+
+	if (headless)
+	{
+		ReportFrameTimes();
+	}
+	profiler.Report("profile.csv");
+	frameCapture.Finish();
+	frameCapture.Report();
+	if (tiledLighting || lightVolumes)
+	{
+		std::cout << "stream buffer stalls: light data " << lightDataStream.Stalls() << ", tile ranges " << tileRangeStream.Stalls()
+			<< ", light indices " << lightIndexStream.Stalls() << ", instances " << volumeInstanceStream.Stalls() << std::endl;
 	}
 
 	std::cout << "window closed" << std::endl;
@@ -1042,3 +1617,140 @@ void GLWindowManager::renderQuad()
 	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
 	glBindVertexArray(0);
 }
+
+//lighting pass with light volumes: called like renderQuad, with lPass in use and the g-buffer textures bound.
+//Writes the ambient term and then every visible light into lightAccum, and copies the result to the window
+void GLWindowManager::renderLightVolumes()
+{
+	if (sphereVAO == 0)
+	{
+		//uv sphere, scaled so its faces never cut inside the unit sphere
+		const int slices = 16, stacks = 8;
+		float scale = 1.0f / (cos(glm::pi<float>() / slices) * cos(glm::pi<float>() / (2 * stacks)));
+		std::vector<float> sphereVertices;
+		std::vector<unsigned short> sphereIndices;
+		for (int i = 0; i <= stacks; i++)
+		{
+			float theta = glm::pi<float>() * i / stacks;
+			for (int j = 0; j <= slices; j++)
+			{
+				float phi = 2.0f * glm::pi<float>() * j / slices;
+				sphereVertices.push_back(scale * sin(theta) * cos(phi));
+				sphereVertices.push_back(scale * cos(theta));
+				sphereVertices.push_back(scale * sin(theta) * sin(phi));
+			}
+		}
+		for (int i = 0; i < stacks; i++)
+		{
+			for (int j = 0; j < slices; j++)
+			{
+				unsigned short a = i * (slices + 1) + j, b = a + slices + 1;
+				unsigned short quad[6] = { a, (unsigned short)(b + 1), b, a, (unsigned short)(a + 1), (unsigned short)(b + 1) }; //ccw seen from outside
+				sphereIndices.insert(sphereIndices.end(), quad, quad + 6);
+			}
+		}
+		sphereIndexCount = (unsigned int)sphereIndices.size();
+
+		glGenVertexArrays(1, &sphereVAO);
+		glGenBuffers(1, &sphereVBO);
+		glGenBuffers(1, &sphereEBO);
+		volumeInstanceStream.Initialize(pointLights.size() * sizeof(uint32_t));
+		glBindVertexArray(sphereVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, sphereVBO);
+		glBufferData(GL_ARRAY_BUFFER, sphereVertices.size() * sizeof(float), sphereVertices.data(), GL_STATIC_DRAW);
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, sphereEBO);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sphereIndices.size() * sizeof(unsigned short), sphereIndices.data(), GL_STATIC_DRAW);
+
+		//one light index per instance, pointed at this frame's region of volumeInstanceStream before drawing
+		glEnableVertexAttribArray(1);
+		glVertexAttribDivisor(1, 1);
+		glBindVertexArray(0);
+	}
+
+	//cpu: drops the lights outside the screen and bounds the others with a single scissor rectangle
+	profiler.BeginCPU(FrameProfiler::CPU_LIGHT_BINNING);
+	visibleLights.clear();
+	TileRect scissor = { (int)screenWidth, (int)screenHeight, -1, -1 };
+	for (size_t i = 0; i < pointLights.size(); i++)
+	{
+		TileRect rect = LightTileRect(pointLights[i], view, projection, zNear, zFar, screenWidth, screenHeight, screenWidth, screenHeight, 1);
+		if (rect.x0 > rect.x1 || rect.y0 > rect.y1)
+			continue;
+		visibleLights.push_back((uint32_t)i);
+		scissor.x0 = min(scissor.x0, rect.x0);
+		scissor.y0 = min(scissor.y0, rect.y0);
+		scissor.x1 = max(scissor.x1, rect.x1);
+		scissor.y1 = max(scissor.y1, rect.y1);
+	}
+	profiler.EndCPU(FrameProfiler::CPU_LIGHT_BINNING);
+
+	//copy of the g-buffer depth and stencil
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, gBuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, lightAccumBuffer);
+	glBlitFramebuffer(0, 0, screenWidth, screenHeight, 0, 0, screenWidth, screenHeight, GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, lightAccumBuffer);
+	glClear(GL_COLOR_BUFFER_BIT);
+
+	//ambient, only where there is geometry
+	glEnable(GL_STENCIL_TEST);
+	glStencilFunc(GL_EQUAL, 1, 0xFF);
+	glStencilMask(0x00);
+	glDisable(GL_DEPTH_TEST);
+	renderQuad();
+
+	if (!visibleLights.empty())
+	{
+		profiler.BeginCPU(FrameProfiler::CPU_UNIFORM_UPLOAD);
+		void* instances = volumeInstanceStream.Map(visibleLights.size() * sizeof(uint32_t));
+		memcpy(instances, visibleLights.data(), visibleLights.size() * sizeof(uint32_t));
+		size_t instanceOffset = volumeInstanceStream.Unmap();
+		glBindVertexArray(sphereVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, volumeInstanceStream.Buffer());
+		glVertexAttribIPointer(1, 1, GL_UNSIGNED_INT, sizeof(uint32_t), (void*)instanceOffset);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glBindVertexArray(0);
+
+		glUseProgram(vPass);
+		glUniform1i(volumeLightDataBaseLocation, lightDataBase);
+		profiler.EndCPU(FrameProfiler::CPU_UNIFORM_UPLOAD);
+
+		glActiveTexture(GL_TEXTURE6);
+		glBindTexture(GL_TEXTURE_BUFFER, lightDataStream.Texture());
+
+		//back faces behind the surface: pixels in front of the far side of the sphere. The shader discards the ones
+		//outside the radius. Depth clamp keeps the spheres crossing the far plane
+		glEnable(GL_DEPTH_TEST);
+		glDepthFunc(GL_GEQUAL);
+		glDepthMask(GL_FALSE);
+		glEnable(GL_DEPTH_CLAMP);
+		glEnable(GL_CULL_FACE);
+		glCullFace(GL_FRONT);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ONE, GL_ONE);
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(scissor.x0, scissor.y0, scissor.x1 - scissor.x0 + 1, scissor.y1 - scissor.y0 + 1);
+
+		glBindVertexArray(sphereVAO);
+		glDrawElementsInstanced(GL_TRIANGLES, sphereIndexCount, GL_UNSIGNED_SHORT, 0, (GLsizei)visibleLights.size());
+		glBindVertexArray(0);
+
+		glDisable(GL_SCISSOR_TEST);
+		glDisable(GL_BLEND);
+		glDisable(GL_CULL_FACE);
+		glCullFace(GL_BACK);
+		glDisable(GL_DEPTH_CLAMP);
+		glDepthMask(GL_TRUE);
+		glDepthFunc(GL_LESS);
+	}
+	glStencilMask(0xFF);
+	glDisable(GL_STENCIL_TEST);
+	glEnable(GL_DEPTH_TEST);
+
+	//result to the window
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, lightAccumBuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, screenWidth, screenHeight, 0, 0, screenWidth, screenHeight, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
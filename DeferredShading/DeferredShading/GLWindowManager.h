@@ -6,12 +6,59 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
+#include <string>
+#include <unordered_map>
 #include <vector>
 #include <tiny_obj_loader.h>
 
+#include "FrameProfiler.h"
+#include "FrameCapture.h"
+#include "LightCulling.h"
+#include "MeshCache.h"
+#include "MeshProcessing.h"
+#include "ProgramCache.h"
+#include "StreamBuffer.h"
+#include "TextureLoader.h"
+
 
 using namespace std;
 
+//std140 mirrors of the Camera and Lights uniform blocks of the shaders
+struct CameraBlock
+{
+	glm::mat4 mvp;
+	glm::mat4 mv;
+	glm::mat4 v;
+	glm::mat4 m;
+	glm::mat4 ITmv;
+	glm::mat4 vp;
+	glm::mat4 invProjection;
+	glm::mat4 invView;
+	glm::vec3 eye;
+	float padding;
+};
+
+struct LightsBlock
+{
+	glm::vec4 positions[32];
+	glm::vec4 colors[32];
+	int nLights;
+	int padding[3];
+};
+
+//feature bits of a shader permutation, turned into #defines by BuildShader. Without PERMUTATION_SPECIALIZED the generic
+//shader is built, which decides every feature through uniforms
+enum ShaderPermutation
+{
+	PERMUTATION_SPECIALIZED = 1 << 0,
+	PERMUTATION_NORMAL_MAP = 1 << 1,
+	PERMUTATION_COMPACT_GBUFFER = 1 << 2,
+	PERMUTATION_TILED_LIGHTING = 1 << 3,
+	PERMUTATION_LIGHT_VOLUME = 1 << 4,
+	PERMUTATION_LIGHT_COUNT_SHIFT = 8, //8 bits: trip count of the loop over the Lights block
+	PERMUTATION_DEBUG_VIEW_SHIFT = 16  //8 bits: selectTexture of the debug pass
+};
+
 class GLWindowManager
 {
 
@@ -36,31 +83,41 @@ private:
 	std::vector<float> colors;
 	std::vector<uint32_t> indices;
 
+	//when LoadModel hits the binary cache, vertices/indices stay empty and the buffers are uploaded from the mapping
+	MeshCache meshCache;
+	unsigned int indexCount;
+
+	bool parallelObjLoading;
+
+	//reorder triangles and vertices for the post-transform cache, overdraw and vertex fetch (MeshOptimizer) before caching
+	bool optimizeMesh;
+
+	//layout of the VBO. For the packed layouts positions are dequantized with positionMin/positionExtent
+	VertexLayout vertexLayout;
+	glm::vec3 positionMin;
+	glm::vec3 positionExtent;
+
+	//textures are decoded and uploaded asynchronously by textureLoader; tex1/tex2/tex3 hold placeholders until then
 	bool IsTextureLoaded;
 	bool IsBumpmapLoaded;
-	int width;
-	int height;
-	int nrChannels;
-	unsigned char *data;
+	std::string texturePath;
+	std::string bumpmapPath;
+	TextureLoader textureLoader;
+	bool compressTextures;
 
 	unsigned int tex1;
 	unsigned int tex2;
 	unsigned int tex3;
 	bool tex3active;
 
-	int width_bm;
-	int height_bm;
-	int nrChannels_bm;
-	unsigned char *bump_data;
-
-	unsigned int texture;
-	unsigned int bumpmap;
-
 	glm::mat4 model;
 	glm::mat4 view;
+	glm::mat4 projection;
 	glm::mat4 modelView;
 	glm::mat4 ITmodelView;
 	glm::mat4 modelViewProjection;
+	glm::mat4 invView;       //inverse(view), kept by UpdateMVPMatrix
+	glm::mat4 invProjection; //inverse(projection), kept by UpdateMVPMatrix
 
 	float angle;
 
@@ -72,10 +129,24 @@ private:
 	//aux functions
 	std::string GLWindowManager::readShaderFile(const char* name);
 	void GLWindowManager::UpdateMVPMatrix();
-	unsigned int GLWindowManager::loadTexture(char const * path);
-	void GLWindowManager::FBO_2_file();
 	void GLWindowManager::renderQuad();
-	void GLWindowManager::BuildShader(const char* filepath, unsigned int* shaderID, int shader_enum);
+	void GLWindowManager::BuildShader(const char* filepath, const std::string& shaderString, const std::string& defines, unsigned int* shaderID, int shader_enum);
+	unsigned int GLWindowManager::BuildProgram(const char* name, const char* vertexPath, const char* fragmentPath, const std::string& defines);
+
+	//shader permutations, built on first use and kept by "<pass>.<permutation>". gPass, lPass, dPass and vPass are the
+	//variants selected for the current state (see SelectShaderVariants)
+	bool specializedShaders;
+	bool programUniformsInitialized;
+	std::unordered_map<std::string, unsigned int> programVariants;
+	unsigned int GLWindowManager::ProgramVariant(const char* pass, const char* vertexPath, const char* fragmentPath, uint32_t permutation);
+	void GLWindowManager::SelectShaderVariants(bool allLightCounts = false);
+	void GLWindowManager::HandleFailedTextures();
+	void GLWindowManager::SetupProgram(unsigned int program);
+
+	//linked programs are cached on disk; useProgramCache == false always compiles (to time cold starts)
+	ProgramCache programCache;
+	bool useProgramCache;
+	int cachedPrograms, compiledPrograms;
 	void GLWindowManager::randomPointInSphere(float *x, float *y, float *z, float radius);
 
 
@@ -87,6 +158,50 @@ private:
 
 	unsigned int rboDepth;
 
+	//compact G-buffer: only gNormal (octahedral world normal, RG16) and gColorSpec, plus the depth as a texture (gDepth)
+	//instead of rboDepth. Positions are reconstructed from the depth in the lighting pass
+	bool compactGBuffer;
+	unsigned int gDepth;
+
+	//tiled lighting: bounded point lights binned into screen tiles on the cpu every frame. Lfragment reads the lights,
+	//the per tile ranges and the light indices from texture buffers, streamed through fenced rings; the *Base uniforms
+	//are the texel offsets of this frame's region
+	bool tiledLighting;
+	int tiledLightCount;
+	std::vector<PointLight> pointLights;
+	TileLightLists tileLists;
+	StreamBuffer lightDataStream, tileRangeStream, lightIndexStream;
+	int lightDataBase, tileRangeBase, lightIndexBase;
+	int lightDataBaseLocation, tileRangeBaseLocation, lightIndexBaseLocation, volumeLightDataBaseLocation;
+	void GLWindowManager::StreamLightData();
+	void GLWindowManager::FenceStreams();
+
+	//animated lights: every light circles the vertical axis through lightCenter, starting from lightOrigins. The light
+	//data is streamed again every frame
+	bool animateLights;
+	bool lightDataDirty;
+	glm::vec3 lightCenter;
+	std::vector<glm::vec3> lightOrigins;
+	void GLWindowManager::AnimatePointLights(float time);
+
+	//clustered lighting: same lights and buffers, binned into froxels instead of 2D tiles
+	bool clusteredLighting;
+	ClusteredLightBinner clusterBinner;
+
+	//light volumes: the same bounded lights drawn as instanced spheres (vPass) with additive blending into lightAccum,
+	//only over pixels the geometry pass marked in the stencil. Lights off screen are culled on the cpu and the batch
+	//is scissored to the union of the screen rectangles of the others
+	bool lightVolumes;
+	unsigned int vPass;
+	unsigned int lightAccumBuffer, lightAccumTexture, lightAccumDepth;
+	unsigned int sphereVAO = 0;
+	unsigned int sphereVBO, sphereEBO, sphereIndexCount;
+	StreamBuffer volumeInstanceStream;
+	std::vector<uint32_t> visibleLights;
+	void GLWindowManager::renderLightVolumes();
+	void GLWindowManager::GeneratePointLights(glm::vec3 boundsMin, glm::vec3 boundsMax);
+	void GLWindowManager::UploadTileLists();
+
 	unsigned int lPass;
 
 	unsigned int dPass; //debug stage
@@ -95,6 +210,36 @@ private:
 
 	unsigned int quadVAO = 0;
 	unsigned int quadVBO;
+
+	//per frame data lives in uniform buffers, uploaded only when it changes; every other uniform is set once, after
+	//linking (see InitializeProgramUniforms)
+	unsigned int cameraUBO, lightsUBO;
+	CameraBlock cameraBlock;
+	bool cameraUploaded;
+	LightsBlock lightsBlock;
+	bool lightsDirty;
+	int selectTextureLocation;
+	void GLWindowManager::InitializeProgramUniforms();
+	void GLWindowManager::UpdateUniformBuffers();
+
+	//headless benchmark mode: invisible window, scripted camera, fixed number of frames
+	bool headless = false;
+	int benchmarkFrames = 0;
+	std::vector<double> frameTimes;
+	void GLWindowManager::UpdateScriptedCamera(int frame);
+	void GLWindowManager::ReportFrameTimes();
+
+	//per-pass gpu/cpu timings, reported when the render loop exits
+	FrameProfiler profiler;
+
+	//frame capture: every captureInterval-th frame (0: none) is written to capture_<frame>.png (.qoi with qoiCaptures),
+	//and the frame the C key is pressed to output.png
+	FrameCapture frameCapture;
+	int captureInterval;
+	bool qoiCaptures;
+	bool captureKeyDown;
+	bool captureRequested;
+	void GLWindowManager::CaptureFrame(int frame);
 	
 	
 
@@ -106,6 +251,20 @@ public:
 	void GLWindowManager::LoadTexture(const char* filepath);
 	void GLWindowManager::LoadBumpmap(const char* filepath);
 	void GLWindowManager::StartRenderLoop();
+	void GLWindowManager::SetHeadless(int nFrames);
+	void GLWindowManager::SetParallelObjLoading(bool parallel);
+	void GLWindowManager::SetMeshOptimization(bool optimize);
+	void GLWindowManager::SetVertexLayout(VertexLayout layout);
+	void GLWindowManager::SetCompactGBuffer(bool compact);
+	void GLWindowManager::SetTiledLighting(int nLights);
+	void GLWindowManager::SetClusteredLighting(int nLights);
+	void GLWindowManager::SetLightVolumes(int nLights);
+	void GLWindowManager::SetAnimatedLights(bool animate);
+	void GLWindowManager::SetProgramCache(bool cache);
+	void GLWindowManager::SetSpecializedShaders(bool specialized);
+	void GLWindowManager::SetTextureCompression(bool compress);
+	void GLWindowManager::SetCaptureInterval(int nFrames);
+	void GLWindowManager::SetQoiCaptures(bool qoi);
 
 
 	float scale;
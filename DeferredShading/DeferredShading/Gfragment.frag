@@ -4,16 +4,19 @@
 
 //Fragment Shader
 
-//matriz model-view-projection, model-view e view
-uniform mat4 mvp;
-uniform mat4 mv;
-uniform mat4 v;
-
-//matriz inversa transposta da model-view. Usada para as normais?
-uniform mat4 ITmv;
-
-//eye, em coordenadas do mundo
-uniform vec3 eye;
+//dados da câmera (std140): um uniform buffer compartilhado por todos os programas, só reenviado quando muda
+layout (std140) uniform Camera
+{
+	mat4 mvp;           //model-view-projection
+	mat4 mv;            //model-view
+	mat4 v;             //view
+	mat4 m;             //model
+	mat4 ITmv;          //inversa transposta da model-view
+	mat4 vp;            //view-projection
+	mat4 invProjection;
+	mat4 invView;
+	vec3 eye;           //em coordenadas do mundo
+};
 
 in vec3 fgPosition;
 in vec4 fgColor;
@@ -46,11 +49,34 @@ uniform sampler2D texture_data;
 uniform sampler2D bumpmap;
 
 //função auxiliar para ajuste das coordenadas do bumpmap
-vec3 expand(vec3 v)
+vec2 expand(vec2 v)
 {
 	return (v - 0.5) * 2;
 }
 
+//G-buffer compacto (compactGBuffer): a normal sai já em coordenadas do mundo, em octaedro no RG16 do gNormal,
+//e a posição é reconstruída da profundidade no lighting pass. gPosition, gTangent e gBitangent não são escritos.
+//Sem normalMapping (nenhum bumpmap carregado) a normal é a da superfície e o bumpmap não é lido
+
+//permutações: BuildShader injeta SPECIALIZED e as constantes das features; sem elas (shader genérico) vêm de uniforms
+#ifdef SPECIALIZED
+const bool compactGBuffer = COMPACT_GBUFFER;
+const bool normalMapping = NORMAL_MAP;
+#else
+uniform bool compactGBuffer;
+uniform bool normalMapping;
+#endif
+
+vec2 octEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	if (n.z < 0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0 ? 1.0 : -1.0, n.y >= 0 ? 1.0 : -1.0);
+	}
+	return n.xy;
+}
+
 
 layout (location = 0) out vec3 gPosition; //vai sair em coordenadas do modelo!
 layout (location = 1) out vec3 gNormal;
@@ -65,8 +91,24 @@ void main()
 	gPosition = fgPosition;
 
 	//usando mapeamento de normais
-	vec3 normalTex = vec3(texture(bumpmap, fgTexCoord)); //precisa do vec3 cast nessa linha?
-	gNormal = expand(normalTex); 
+	if (normalMapping)
+	{
+		//o bumpmap guarda só x e y (RG, ou BC5 comprimido); z é reconstruído, sempre positivo no espaço da tangente
+		vec2 normalTex = expand(texture(bumpmap, fgTexCoord).rg);
+		gNormal = vec3(normalTex, sqrt(max(0.0, 1.0 - dot(normalTex, normalTex))));
+	}
+	else
+	{
+		gNormal = vec3(0, 0, 1); //espaço da tangente
+	}
+
+	if (compactGBuffer)
+	{
+		//TBN aplicada aqui, uma vez por pixel, em vez de uma vez por luz no lighting pass
+		mat3 TBN = mat3(normalize(fgTangent), normalize(fgBitangent), normalize(fgNormal));
+		vec3 worldNormal = normalize(mat3(m) * (TBN * gNormal));
+		gNormal = vec3(octEncode(worldNormal) * 0.5 + 0.5, 0);
+	}
 
 	gTangent = fgTangent;
 	gBitangent = fgBitangent;
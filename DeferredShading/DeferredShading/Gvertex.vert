@@ -6,7 +6,7 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 vtColor;
 layout (location = 2) in vec3 vtNormal;
 layout (location = 3) in vec2 vtTexCoord;
-layout (location = 4) in vec3 vtTangent;
+layout (location = 4) in vec4 vtTangent; //w: sinal da bitangente no layout compacto
 layout (location = 5) in vec3 vtBitangent;
 
 out vec3 fgPosition;
@@ -17,30 +17,62 @@ out vec2 fgTexCoord;
 out vec3 fgTangent;
 out vec3 fgBitangent;
 
-//matriz model-view-projection
-uniform mat4 mvp;
-uniform mat4 mv;
-uniform mat4 v;
-uniform mat4 ITmv; // a inversa transposta da model-view
+//dados da câmera (std140): um uniform buffer compartilhado por todos os programas, só reenviado quando muda
+layout (std140) uniform Camera
+{
+	mat4 mvp;           //model-view-projection
+	mat4 mv;            //model-view
+	mat4 v;             //view
+	mat4 m;             //model
+	mat4 ITmv;          //inversa transposta da model-view
+	mat4 vp;            //view-projection
+	mat4 invProjection;
+	mat4 invView;
+	vec3 eye;           //em coordenadas do mundo
+};
+
+//layout compacto do vbo: posição quantizada na AABB da malha, normal e tangente em octaedro e bitangente reconstruída
+uniform bool packedVertices;
+uniform vec3 positionMin;
+uniform vec3 positionExtent;
 
-//eye, em coordenadas do mundo
-uniform vec3 eye;
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0 ? 1.0 : -1.0, n.y >= 0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
 
 void main()
 {
 	
 	//multiplicação da posição do vértice pela matriz model-view-projection
 	
-	gl_Position = mvp * vec4(aPos.x, aPos.y, aPos.z, 1.0); //???
+	//para o layout em floats, positionMin = 0 e positionExtent = 1
+	vec3 position = positionMin + aPos * positionExtent;
+
+	gl_Position = mvp * vec4(position, 1.0); //???
 	
-	fgPosition= vec3(aPos.x, aPos.y, aPos.z);
+	fgPosition = position;
 	
 	//passa adiante cor para o fragment shader
 	fgColor = vec4(vtColor, 1.0f);
-	fgNormal = vtNormal;
-	
 	fgTexCoord = vtTexCoord;
-	fgTangent = vtTangent;
-	fgBitangent = vtBitangent;
+
+	if (packedVertices)
+	{
+		fgNormal = octDecode(vtNormal.xy);
+		fgTangent = octDecode(vtTangent.xy);
+		fgBitangent = (vtTangent.w < 0 ? -1.0 : 1.0) * cross(fgNormal, fgTangent);
+	}
+	else
+	{
+		fgNormal = vtNormal;
+		fgTangent = vtTangent.xyz;
+		fgBitangent = vtBitangent;
+	}
 
 }
\ No newline at end of file
@@ -4,29 +4,43 @@
 
 //Fragment Shader
 
-//matriz model-view-projection
-uniform mat4 mvp;
-
-//matriz model-view
-uniform mat4 mv;
-
-//matriz de view
-uniform mat4 v;
-
-//matriz de model
-uniform mat4 m;
-
-//matriz inversa transposta da model-view. Usada para as normais
-uniform mat4 ITmv;
-
-//eye, em coordenadas do mundo
-uniform vec3 eye;
+//dados da câmera (std140): um uniform buffer compartilhado por todos os programas, só reenviado quando muda
+layout (std140) uniform Camera
+{
+	mat4 mvp;           //model-view-projection
+	mat4 mv;            //model-view
+	mat4 v;             //view
+	mat4 m;             //model
+	mat4 ITmv;          //inversa transposta da model-view
+	mat4 vp;            //view-projection
+	mat4 invProjection;
+	mat4 invView;
+	vec3 eye;           //em coordenadas do mundo
+};
 
 const int N_LIGHTS = 32;
 
-uniform int nLights; //o numero de luzes a ser realmente usado
-uniform vec3 lightPositions[N_LIGHTS];
-uniform vec3 lightColors[N_LIGHTS];
+//tabela de luzes (std140), reenviada só quando nLights muda
+layout (std140) uniform Lights
+{
+	vec3 lightPositions[N_LIGHTS];
+	vec3 lightColors[N_LIGHTS];
+	int nLights; //o numero de luzes a ser realmente usado
+};
+
+//permutações: BuildShader injeta SPECIALIZED e as constantes das features, e o compilador desenrola o loop das luzes
+//e elimina os caminhos mortos. Sem elas (shader genérico) tudo é decidido por uniforms.
+//LIGHT_COUNT é nLights arredondado para cima a uma potência de 2 (poucas variantes): o loop para em nLights
+#ifdef SPECIALIZED
+const bool compactGBuffer = COMPACT_GBUFFER;
+const bool tiledLighting = TILED_LIGHTING;
+const bool lightVolume = LIGHT_VOLUME;
+#else
+uniform bool compactGBuffer;
+uniform bool tiledLighting;
+uniform bool lightVolume;
+#define LIGHT_COUNT nLights
+#endif
 vec3 lightSpecular = vec3(0.5, 0.5, 0.5);
 struct material
 {
@@ -50,6 +64,35 @@ uniform sampler2D gColorSpec;
 uniform sampler2D gTangent;
 uniform sampler2D gBitangent;
 
+//G-buffer compacto (compactGBuffer): só gNormal (octaedro, mundo), gColorSpec e a profundidade
+uniform sampler2D gDepth;
+
+//tiled lighting: luzes pontuais com raio (lightData: 2 texels por luz, posição + raio e cor), listas por tile em
+//tileRanges (offset, quantidade em lightIndices), tiles de tileSize pixels a partir do canto inferior esquerdo.
+//No modo clustered (clusterSlices > 0) cada tile é dividido em fatias exponenciais de profundidade:
+//fatia = log(profundidade / clusterNear) * clusterScale
+uniform int tileSize;
+uniform int tilesX;
+uniform int tilesY;
+uniform int clusterSlices;
+uniform float clusterNear;
+uniform float clusterScale;
+uniform samplerBuffer lightData;
+uniform usamplerBuffer tileRanges;
+uniform usamplerBuffer lightIndices;
+//os três são anéis reescritos a cada quadro (StreamBuffer): offset, em texels, da região deste quadro
+uniform int lightDataBase;
+uniform int tileRangeBase;
+uniform int lightIndexBase;
+
+//light volumes (lightVolume): cada instância da esfera (lightVolume.vert) ilumina só a luz volumeLight, somada por
+//blending, e as coordenadas do G-buffer vêm de gl_FragCoord
+uniform vec2 screenSize;
+flat in int volumeLight;
+
+//coordenada do pixel no G-buffer
+vec2 gbufferCoord;
+
 
 //in vec3 fgTangent;
 //in vec3 fgBitangent; // ???
@@ -59,8 +102,142 @@ out vec4 pixelColor;
 //luz ambiente
 vec4 scene_ambient = vec4(0.2, 0.2, 0.2, 1);
 
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0 ? 1.0 : -1.0, n.y >= 0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
+//posição no mundo a partir da profundidade e das inversas da projeção e da view
+vec3 worldPositionFromDepth(vec2 uv)
+{
+	float depth = texture(gDepth, uv).r;
+	vec4 viewPosition = invProjection * vec4(uv * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+	return (invView * vec4(viewPosition.xyz / viewPosition.w, 1.0)).xyz;
+}
+
+//superfície em coordenadas do mundo, para os dois layouts do G-buffer
+void worldSurface(out vec3 position, out vec3 normal)
+{
+	if (compactGBuffer)
+	{
+		position = worldPositionFromDepth(gbufferCoord);
+		normal = octDecode(texture(gNormal, gbufferCoord).rg * 2.0 - 1.0);
+	}
+	else
+	{
+		vec3 tangent = vec3(texture(gTangent, gbufferCoord));
+		vec3 bitangent = vec3(texture(gBitangent, gbufferCoord));
+		mat3 TBN = mat3(normalize(mat3(m) * tangent), normalize(mat3(m) * bitangent), normalize(mat3(m) * cross(tangent, bitangent)));
+		position = (m * vec4(vec3(texture(gPosition, gbufferCoord)), 1)).xyz;
+		normal = normalize(TBN * vec3(texture(gNormal, gbufferCoord)));
+	}
+}
+
+//phong difuso + especular de uma luz, no mundo
+vec3 phong(vec3 L, vec3 normal, vec3 V, vec3 albedo, vec3 lightColor)
+{
+	float dotp = dot(L, normal);
+	if (dotp <= 0)
+		return vec3(0, 0, 0);
+	vec3 R = reflect(-L, normal);
+	return lightColor * dotp * albedo + Ks * pow(max(dot(R, V), 0.0), Mshi) * lightSpecular * lightColor;
+}
+
+//iluminação com o G-buffer compacto: normal e posição já estão no mundo, sem TBN por pixel
+vec4 shadeCompact()
+{
+	vec3 position, normal;
+	worldSurface(position, normal);
+	vec4 fgColor = texture(gColorSpec, gbufferCoord);
+
+	vec3 V = normalize(eye - position);
+	vec3 color = vec3(0, 0, 0);
+	for(int i = 0; i < LIGHT_COUNT; i++)
+	{
+		if (i >= nLights)
+			break;
+		color += phong(normalize(lightPositions[i] - position), normal, V, fgColor.rgb, lightColors[i]);
+	}
+
+	return scene_ambient * vec4(Ka, 1.0) + vec4(color, 1);
+}
+
+//luz pontual com raio (lightData), com atenuação suave até zero no raio
+vec3 boundedLight(int light, vec3 position, vec3 normal, vec3 V, vec3 albedo)
+{
+	vec4 positionRadius = texelFetch(lightData, lightDataBase + 2 * light);
+	vec3 lightColor = texelFetch(lightData, lightDataBase + 2 * light + 1).rgb;
+
+	vec3 toLight = positionRadius.xyz - position;
+	float falloff = clamp(1.0 - dot(toLight, toLight) / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+	if (falloff <= 0)
+		return vec3(0, 0, 0);
+	return falloff * falloff * phong(normalize(toLight), normal, V, albedo, lightColor);
+}
+
+//tiled/clustered: só as luzes que a CPU associou ao tile (ou cluster) deste pixel, com alcance limitado
+vec4 shadeTiled()
+{
+	vec3 position, normal;
+	worldSurface(position, normal);
+	vec4 fgColor = texture(gColorSpec, gbufferCoord);
+	vec3 V = normalize(eye - position);
+
+	ivec2 tile = ivec2(gl_FragCoord.xy) / tileSize;
+	int cell = tile.y * tilesX + tile.x;
+	if (clusterSlices > 0)
+	{
+		float depth = -(v * vec4(position, 1)).z;
+		int slice = clamp(int(floor(log(depth / clusterNear) * clusterScale)), 0, clusterSlices - 1);
+		cell += slice * tilesX * tilesY;
+	}
+	uvec2 range = texelFetch(tileRanges, tileRangeBase + cell).rg;
+
+	vec3 color = vec3(0, 0, 0);
+	for(uint i = 0u; i < range.y; i++)
+	{
+		color += boundedLight(int(texelFetch(lightIndices, lightIndexBase + int(range.x + i)).r), position, normal, V, fgColor.rgb);
+	}
+
+	return scene_ambient * vec4(Ka, 1.0) + vec4(color, 1);
+}
+
+//light volumes: só a contribuição da luz desta instância, o ambiente é desenhado antes por um quad
+vec4 shadeVolume()
+{
+	vec3 position, normal;
+	worldSurface(position, normal);
+	vec4 fgColor = texture(gColorSpec, gbufferCoord);
+
+	vec3 color = boundedLight(volumeLight, position, normal, normalize(eye - position), fgColor.rgb);
+	if (color == vec3(0, 0, 0))
+		discard;
+	return vec4(color, 0);
+}
+
 void main()
 {
+	gbufferCoord = lightVolume ? gl_FragCoord.xy / screenSize : fgtexCoord;
+	if (lightVolume)
+	{
+		pixelColor = shadeVolume();
+		return;
+	}
+	if (tiledLighting)
+	{
+		pixelColor = shadeTiled();
+		return;
+	}
+	if (compactGBuffer)
+	{
+		pixelColor = shadeCompact();
+		return;
+	}
 	
 	vec3 position = vec3(texture(gPosition, fgtexCoord)); //model
 	vec3 bumpNormal = vec3(texture(gNormal, fgtexCoord)); //tangent
@@ -104,8 +281,10 @@ void main()
 	float reductionFactor = 1;
 
 	//cálculo da iluminação
-	for(int i = 0; i < nLights; i++)
+	for(int i = 0; i < LIGHT_COUNT; i++)
 	{
+		if (i >= nLights)
+			break;
 		//calculo vetor L nas coordenadas de textura
 		vec3 Lpos = TBN * lightPositions[i];
 		vec3 L = normalize(lightPositions[i] - pos3);
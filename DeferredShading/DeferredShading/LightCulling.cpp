@@ -0,0 +1,303 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define LIGHT_CULLING_SSE 1
+#include <emmintrin.h>
+#endif
+
+#include "LightCulling.h"
+
+using namespace std;
+
+TileRect LightTileRect(const PointLight& light, const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar,
+	int width, int height, int tilesX, int tilesY, int tileSize)
+{
+	TileRect culled = { 1, 1, 0, 0 };
+	TileRect fullScreen = { 0, 0, tilesX - 1, tilesY - 1 };
+
+	//the camera looks down -z
+	glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+	float r = light.radius;
+	if (center.z - r > -zNear || center.z + r < -zFar)
+		return culled;
+	if (center.z + r > -zNear)
+		return fullScreen;
+
+	glm::vec2 ndcMin(1e30f), ndcMax(-1e30f);
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec3 corner = center + glm::vec3(i & 1 ? r : -r, i & 2 ? r : -r, i & 4 ? r : -r);
+		glm::vec4 clip = projection * glm::vec4(corner, 1.0f);
+		glm::vec2 ndc = glm::vec2(clip) / clip.w;
+		ndcMin = glm::min(ndcMin, ndc);
+		ndcMax = glm::max(ndcMax, ndc);
+	}
+	if (ndcMax.x < -1.0f || ndcMax.y < -1.0f || ndcMin.x > 1.0f || ndcMin.y > 1.0f)
+		return culled;
+
+	TileRect rect;
+	rect.x0 = max(0, (int)floor((ndcMin.x * 0.5f + 0.5f) * width) / tileSize);
+	rect.y0 = max(0, (int)floor((ndcMin.y * 0.5f + 0.5f) * height) / tileSize);
+	rect.x1 = min(tilesX - 1, (int)floor((ndcMax.x * 0.5f + 0.5f) * width) / tileSize);
+	rect.y1 = min(tilesY - 1, (int)floor((ndcMax.y * 0.5f + 0.5f) * height) / tileSize);
+	return rect;
+}
+
+void BinLightsInTiles(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar,
+	int width, int height, TileLightLists& lists)
+{
+	lists.tilesX = (width + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	lists.tilesY = (height + LIGHT_TILE_SIZE - 1) / LIGHT_TILE_SIZE;
+	lists.slices = 1;
+	size_t nTiles = (size_t)lists.tilesX * lists.tilesY;
+
+	std::vector<TileRect> rects(lights.size());
+	lists.tileRanges.assign(2 * nTiles, 0);
+
+	//first pass: counts the lights of each tile
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		rects[i] = LightTileRect(lights[i], view, projection, zNear, zFar, width, height, lists.tilesX, lists.tilesY, LIGHT_TILE_SIZE);
+		for (int y = rects[i].y0; y <= rects[i].y1; y++)
+			for (int x = rects[i].x0; x <= rects[i].x1; x++)
+				lists.tileRanges[2 * (y * lists.tilesX + x) + 1]++;
+	}
+
+	//offsets, then the second pass fills the lists in light order
+	uint32_t total = 0;
+	for (size_t t = 0; t < nTiles; t++)
+	{
+		lists.tileRanges[2 * t] = total;
+		total += lists.tileRanges[2 * t + 1];
+		lists.tileRanges[2 * t + 1] = 0;
+	}
+	lists.lightIndices.resize(total);
+	for (size_t i = 0; i < lights.size(); i++)
+	{
+		for (int y = rects[i].y0; y <= rects[i].y1; y++)
+		{
+			for (int x = rects[i].x0; x <= rects[i].x1; x++)
+			{
+				uint32_t* range = &lists.tileRanges[2 * (y * lists.tilesX + x)];
+				lists.lightIndices[range[0] + range[1]++] = (uint32_t)i;
+			}
+		}
+	}
+}
+
+//bit i set when the sphere touches cluster first + i
+static inline int SphereAabb4(const float* const bounds[6], size_t first, glm::vec3 center, float radius2)
+{
+#ifdef LIGHT_CULLING_SSE
+	__m128 zero = _mm_setzero_ps();
+	__m128 distance2 = zero;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		__m128 c = _mm_set1_ps(center[axis]);
+		__m128 below = _mm_max_ps(_mm_sub_ps(_mm_loadu_ps(bounds[axis] + first), c), zero);
+		__m128 above = _mm_max_ps(_mm_sub_ps(c, _mm_loadu_ps(bounds[3 + axis] + first)), zero);
+		__m128 d = _mm_add_ps(below, above);
+		distance2 = _mm_add_ps(distance2, _mm_mul_ps(d, d));
+	}
+	return _mm_movemask_ps(_mm_cmple_ps(distance2, _mm_set1_ps(radius2)));
+#else
+	int mask = 0;
+	for (int lane = 0; lane < 4; lane++)
+	{
+		float distance2 = 0.0f;
+		for (int axis = 0; axis < 3; axis++)
+		{
+			float d = max(bounds[axis][first + lane] - center[axis], 0.0f) + max(center[axis] - bounds[3 + axis][first + lane], 0.0f);
+			distance2 += d * d;
+		}
+		mask |= (distance2 <= radius2) << lane;
+	}
+	return mask;
+#endif
+}
+
+ClusteredLightBinner::ClusteredLightBinner()
+{
+	zNear = 0.1f;
+	zFar = 100.0f;
+	sliceScale = 1.0f;
+	width = height = tilesX = tilesY = 0;
+}
+
+void ClusteredLightBinner::SetFrustum(const glm::mat4& projection, float zNear, float zFar, int width, int height)
+{
+	this->projection = projection;
+	this->zNear = zNear;
+	this->zFar = zFar;
+	this->width = width;
+	this->height = height;
+	tilesX = (width + CLUSTER_TILE_SIZE - 1) / CLUSTER_TILE_SIZE;
+	tilesY = (height + CLUSTER_TILE_SIZE - 1) / CLUSTER_TILE_SIZE;
+	sliceScale = CLUSTER_SLICES / log(zFar / zNear);
+
+	size_t nClusters = (size_t)tilesX * tilesY * CLUSTER_SLICES;
+	for (auto* bounds : { &minX, &minY, &minZ, &maxX, &maxY, &maxZ })
+		bounds->assign(nClusters + 3, 0.0f);
+
+	//view space x = ndc x * depth / projection[0][0], and the same for y
+	for (int k = 0; k < CLUSTER_SLICES; k++)
+	{
+		float depth0 = zNear * pow(zFar / zNear, float(k) / CLUSTER_SLICES);
+		float depth1 = zNear * pow(zFar / zNear, float(k + 1) / CLUSTER_SLICES);
+		for (int y = 0; y < tilesY; y++)
+		{
+			float ndcY0 = 2.0f * (y * CLUSTER_TILE_SIZE) / height - 1.0f;
+			float ndcY1 = 2.0f * min((y + 1) * CLUSTER_TILE_SIZE, height) / height - 1.0f;
+			for (int x = 0; x < tilesX; x++)
+			{
+				float ndcX0 = 2.0f * (x * CLUSTER_TILE_SIZE) / width - 1.0f;
+				float ndcX1 = 2.0f * min((x + 1) * CLUSTER_TILE_SIZE, width) / width - 1.0f;
+
+				size_t c = ((size_t)k * tilesY + y) * tilesX + x;
+				float xs[4] = { ndcX0 * depth0, ndcX1 * depth0, ndcX0 * depth1, ndcX1 * depth1 };
+				float ys[4] = { ndcY0 * depth0, ndcY1 * depth0, ndcY0 * depth1, ndcY1 * depth1 };
+				minX[c] = *min_element(xs, xs + 4) / projection[0][0];
+				maxX[c] = *max_element(xs, xs + 4) / projection[0][0];
+				minY[c] = *min_element(ys, ys + 4) / projection[1][1];
+				maxY[c] = *max_element(ys, ys + 4) / projection[1][1];
+				minZ[c] = -depth1;
+				maxZ[c] = -depth0;
+			}
+		}
+	}
+}
+
+void ClusteredLightBinner::BinChunk(const std::vector<PointLight>& lights, const glm::mat4& view, size_t begin, size_t end, ChunkHits& hits) const
+{
+	const float* const bounds[6] = { minX.data(), minY.data(), minZ.data(), maxX.data(), maxY.data(), maxZ.data() };
+
+	for (size_t i = begin; i < end; i++)
+	{
+		const PointLight& light = lights[i];
+		TileRect rect = LightTileRect(light, view, projection, zNear, zFar, width, height, tilesX, tilesY, CLUSTER_TILE_SIZE);
+		if (rect.x0 > rect.x1 || rect.y0 > rect.y1)
+			continue;
+
+		glm::vec3 center = glm::vec3(view * glm::vec4(light.position, 1.0f));
+		float depth0 = max(-center.z - light.radius, zNear);
+		float depth1 = min(-center.z + light.radius, zFar);
+		int slice0 = max(0, min(CLUSTER_SLICES - 1, (int)floor(log(depth0 / zNear) * sliceScale)));
+		int slice1 = max(0, min(CLUSTER_SLICES - 1, (int)floor(log(depth1 / zNear) * sliceScale)));
+		float radius2 = light.radius * light.radius;
+
+		for (int k = slice0; k <= slice1; k++)
+		{
+			for (int y = rect.y0; y <= rect.y1; y++)
+			{
+				size_t row = ((size_t)k * tilesY + y) * tilesX;
+				for (int x = rect.x0; x <= rect.x1; x += 4)
+				{
+					int mask = SphereAabb4(bounds, row + x, center, radius2) & ((1 << min(4, rect.x1 - x + 1)) - 1);
+					for (int lane = 0; mask != 0; lane++, mask >>= 1)
+					{
+						if (mask & 1)
+						{
+							hits.clusters.push_back((uint32_t)(row + x + lane));
+							hits.lights.push_back((uint32_t)i);
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+void ClusteredLightBinner::Bin(const std::vector<PointLight>& lights, const glm::mat4& view, TileLightLists& lists)
+{
+	const size_t grain = 256;
+	size_t nChunks = (lights.size() + grain - 1) / grain;
+	if (chunks.size() < nChunks)
+		chunks.resize(nChunks);
+
+	pool.ParallelFor(lights.size(), grain, [&](size_t begin, size_t end)
+	{
+		ChunkHits& hits = chunks[begin / grain];
+		hits.clusters.clear();
+		hits.lights.clear();
+		BinChunk(lights, view, begin, end, hits);
+	});
+
+	//counting sort of the hits by cluster. Chunks are merged in light order, so every list stays sorted
+	size_t nClusters = (size_t)tilesX * tilesY * CLUSTER_SLICES;
+	lists.tilesX = tilesX;
+	lists.tilesY = tilesY;
+	lists.slices = CLUSTER_SLICES;
+	lists.tileRanges.assign(2 * nClusters, 0);
+	for (size_t k = 0; k < nChunks; k++)
+		for (uint32_t cluster : chunks[k].clusters)
+			lists.tileRanges[2 * cluster + 1]++;
+
+	uint32_t total = 0;
+	fill.resize(nClusters);
+	for (size_t c = 0; c < nClusters; c++)
+	{
+		lists.tileRanges[2 * c] = total;
+		fill[c] = total;
+		total += lists.tileRanges[2 * c + 1];
+	}
+	lists.lightIndices.resize(total);
+	for (size_t k = 0; k < nChunks; k++)
+	{
+		const ChunkHits& hits = chunks[k];
+		for (size_t h = 0; h < hits.clusters.size(); h++)
+			lists.lightIndices[fill[hits.clusters[h]]++] = hits.lights[h];
+	}
+}
+
+void RunLightBinningBenchmark()
+{
+	const int width = 800, height = 600, runs = 10;
+	const float zNear = 0.1f, zFar = 100.0f;
+	glm::mat4 projection = glm::perspective(glm::radians(45.0f), 4.0f / 3.0f, zNear, zFar);
+	glm::mat4 view = glm::lookAt(glm::vec3(0.0f, 0.0f, 10.0f), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+
+	ClusteredLightBinner clustered;
+	clustered.SetFrustum(projection, zNear, zFar, width, height);
+	TileLightLists lists;
+
+	std::default_random_engine generator(17);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	printf("lights, tiled ms, tiled refs, clustered ms, clustered refs\n");
+	for (int nLights = 32; nLights <= 131072; nLights *= 2)
+	{
+		//a 40 x 30 x 80 box in front of the camera, radius shrinking with the light count
+		std::vector<PointLight> lights(nLights);
+		float radius = 20.0f / cbrt((float)nLights);
+		for (PointLight& light : lights)
+		{
+			light.position = glm::vec3(20.0f * unit(generator), 15.0f * unit(generator), -30.0f + 40.0f * unit(generator));
+			light.radius = radius;
+			light.color = glm::vec3(1.0f);
+		}
+
+		double times[2];
+		size_t refs[2];
+		for (int mode = 0; mode < 2; mode++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int run = 0; run < runs; run++)
+			{
+				if (mode == 0)
+					BinLightsInTiles(lights, view, projection, zNear, zFar, width, height, lists);
+				else
+					clustered.Bin(lights, view, lists);
+			}
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			times[mode] = elapsed.count() / runs;
+			refs[mode] = lists.lightIndices.size();
+		}
+		printf("%d, %.3f, %d, %.3f, %d\n", nLights, times[0], (int)refs[0], times[1], (int)refs[1]);
+	}
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "ThreadPool.h"
+
+//a point light with a bounded range: its contribution fades to zero at radius
+struct PointLight
+{
+	glm::vec3 position;
+	float radius;
+	glm::vec3 color;
+};
+
+//screen tile size, in pixels, of the tiled lighting pass
+const int LIGHT_TILE_SIZE = 16;
+
+//clustered lighting: screen tiles of CLUSTER_TILE_SIZE pixels, each split in CLUSTER_SLICES exponential depth slices
+const int CLUSTER_TILE_SIZE = 32;
+const int CLUSTER_SLICES = 24;
+
+//per tile (or per cluster) light lists. tileRanges holds one (offset, count) pair into lightIndices per cell, tiles in
+//rows starting from the bottom left corner of the screen, like gl_FragCoord, and clusters slice after slice
+struct TileLightLists
+{
+	int tilesX;
+	int tilesY;
+	int slices; //1 for plain tiles
+	std::vector<uint32_t> tileRanges;
+	std::vector<uint32_t> lightIndices;
+};
+
+//inclusive tile rectangle covered by a light, or an empty one (x0 > x1) when the light is culled
+struct TileRect
+{
+	int x0, y0, x1, y1;
+};
+
+//screen rectangle, in tiles of tileSize pixels, of the view space bounding box of a light (see BinLightsInTiles).
+//With tileSize = 1 and tilesX/tilesY = width/height it is a pixel rectangle, usable as a scissor
+TileRect LightTileRect(const PointLight& light, const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar,
+	int width, int height, int tilesX, int tilesY, int tileSize);
+
+//bins lights into LIGHT_TILE_SIZE screen tiles. Each light goes to every tile overlapped by the screen rectangle of
+//its view space bounding box, which is conservative; lights crossing the near plane cover the whole screen and
+//lights entirely outside [zNear, zFar] are dropped
+void BinLightsInTiles(const std::vector<PointLight>& lights, const glm::mat4& view, const glm::mat4& projection, float zNear, float zFar,
+	int width, int height, TileLightLists& lists);
+
+//bins lights into froxels: the view frustum cut in screen tiles and exponential depth slices
+//(slice k spans zNear * (zFar / zNear)^(k / CLUSTER_SLICES) to the next one).
+//Each light is tested only against the clusters inside its screen rectangle and depth range, four clusters at a time
+//with SSE sphere-AABB tests, and the lights are spread over a work stealing thread pool
+class ClusteredLightBinner
+{
+public:
+	ClusteredLightBinner();
+
+	//rebuilds the view space bounds of the clusters. Call again whenever the projection or the screen size change
+	void SetFrustum(const glm::mat4& projection, float zNear, float zFar, int width, int height);
+
+	//lights in world space. lightIndices keeps the lights of each cluster in increasing order
+	void Bin(const std::vector<PointLight>& lights, const glm::mat4& view, TileLightLists& lists);
+
+	//slice = log(viewDepth / zNear) * SliceScale()
+	float SliceScale() const { return sliceScale; }
+
+private:
+	//a chunk of lights and the (cluster, light) pairs it produced
+	struct ChunkHits
+	{
+		std::vector<uint32_t> clusters;
+		std::vector<uint32_t> lights;
+	};
+
+	ThreadPool pool;
+	glm::mat4 projection;
+	float zNear, zFar, sliceScale;
+	int width, height, tilesX, tilesY;
+
+	//cluster bounds, structure of arrays with 3 floats of padding so a 4 wide load may start at any cluster
+	std::vector<float> minX, minY, minZ, maxX, maxY, maxZ;
+
+	std::vector<ChunkHits> chunks;
+	std::vector<uint32_t> fill;
+
+	void BinChunk(const std::vector<PointLight>& lights, const glm::mat4& view, size_t begin, size_t end, ChunkHits& hits) const;
+};
+
+//times BinLightsInTiles and ClusteredLightBinner over a sweep of 32 to 131072 random lights (doubling), one line per count.
+//Needs no opengl context
+void RunLightBinningBenchmark();
@@ -6,11 +6,13 @@ layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec2 vertex_texCoord;
 
 out vec2 fgtexCoord;
+flat out int volumeLight; //só usado por lightVolume.vert
 uniform sampler2D gPosition;
 
 
 void main()
 {
 	fgtexCoord = vertex_texCoord;	
+	volumeLight = 0;
 	gl_Position = vec4(aPos, 1);
 }
\ No newline at end of file
@@ -0,0 +1,131 @@
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "MappedFile.h"
+
+MappedFile::MappedFile()
+{
+	opened = false;
+	data = NULL;
+	size = 0;
+#ifdef _WIN32
+	fileHandle = NULL;
+	mappingHandle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize))
+	{
+		CloseHandle(file);
+		return false;
+	}
+	fileHandle = file;
+	size = (size_t)fileSize.QuadPart;
+	opened = true;
+	if (size == 0)
+		return true;
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL)
+	{
+		Close();
+		return false;
+	}
+	mappingHandle = mapping;
+	data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL)
+	{
+		Close();
+		return false;
+	}
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	size = (size_t)st.st_size;
+	opened = true;
+	if (size == 0)
+	{
+		close(fd);
+		return true;
+	}
+
+	void* view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (view == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	madvise(view, size, MADV_SEQUENTIAL);
+	data = view;
+#endif
+	return true;
+}
+
+bool MappedFile::Stat(const char* path, uint64_t* size, int64_t* mtime)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(path, &st) != 0)
+		return false;
+#else
+	struct stat st;
+	if (stat(path, &st) != 0)
+		return false;
+#endif
+	*size = (uint64_t)st.st_size;
+	*mtime = (int64_t)st.st_mtime;
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (data != NULL)
+		UnmapViewOfFile(data);
+	if (mappingHandle != NULL)
+		CloseHandle((HANDLE)mappingHandle);
+	if (fileHandle != NULL)
+		CloseHandle((HANDLE)fileHandle);
+	mappingHandle = NULL;
+	fileHandle = NULL;
+#else
+	if (data != NULL)
+		munmap(data, size);
+#endif
+	opened = false;
+	data = NULL;
+	size = 0;
+}
@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+//read-only memory mapping of a whole file
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	//returns false if the file can't be opened or mapped. Empty files are mapped as Data() == NULL, Size() == 0
+	bool Open(const char* path);
+	void Close();
+
+	//size and modification time of a file, to tell whether a cache built from it is stale. false if it does not exist
+	static bool Stat(const char* path, uint64_t* size, int64_t* mtime);
+
+	bool IsOpen() const { return opened; }
+	const char* Data() const { return (const char*)data; }
+	size_t Size() const { return size; }
+
+private:
+	MappedFile(const MappedFile&);
+	MappedFile& operator=(const MappedFile&);
+
+	bool opened;
+	void* data;
+	size_t size;
+#ifdef _WIN32
+	void* fileHandle;
+	void* mappingHandle;
+#endif
+};
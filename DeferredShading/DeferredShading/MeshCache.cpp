@@ -0,0 +1,109 @@
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "MeshCache.h"
+
+static const char MESH_CACHE_MAGIC[4] = { 'D', 'S', 'M', 'C' };
+
+static std::string CachePath(const char* objPath)
+{
+	return std::string(objPath) + ".meshcache";
+}
+
+MeshCache::MeshCache()
+{
+	vertices = NULL;
+	vertexFloatCount = 0;
+	indices = NULL;
+	indexCount = 0;
+}
+
+MeshCache::~MeshCache()
+{
+	Release();
+}
+
+bool MeshCache::Load(const char* objPath, uint32_t flags, uint32_t floatsPerVertex)
+{
+	Release();
+
+	uint64_t objSize;
+	int64_t objMtime;
+	if (!MappedFile::Stat(objPath, &objSize, &objMtime))
+		return false;
+
+	std::string path = CachePath(objPath);
+
+	if (!file.Open(path.c_str()))
+		return false;
+	if (file.Size() < sizeof(Header))
+	{
+		Release();
+		return false;
+	}
+
+	//validate: magic, version, key and sizes
+	Header header;
+	memcpy(&header, file.Data(), sizeof(Header));
+	uint64_t expectedSize = sizeof(Header) + header.vertexFloatCount * sizeof(float) + header.indexCount * sizeof(uint32_t);
+	if (memcmp(header.magic, MESH_CACHE_MAGIC, 4) != 0 || header.version != VERSION || header.flags != flags
+		|| header.floatsPerVertex != floatsPerVertex || header.objSize != objSize || header.objMtime != objMtime
+		|| expectedSize != file.Size())
+	{
+		Release();
+		return false;
+	}
+
+	const char* payload = file.Data() + sizeof(Header);
+	vertices = (const float*)payload;
+	vertexFloatCount = (size_t)header.vertexFloatCount;
+	indices = (const uint32_t*)(payload + vertexFloatCount * sizeof(float));
+	indexCount = (size_t)header.indexCount;
+	return true;
+}
+
+bool MeshCache::Store(const char* objPath, uint32_t flags, uint32_t floatsPerVertex, const std::vector<float>& vertices, const std::vector<uint32_t>& indices)
+{
+	Header header;
+	memcpy(header.magic, MESH_CACHE_MAGIC, 4);
+	header.version = VERSION;
+	header.flags = flags;
+	header.floatsPerVertex = floatsPerVertex;
+	if (!MappedFile::Stat(objPath, &header.objSize, &header.objMtime))
+		return false;
+	header.vertexFloatCount = vertices.size();
+	header.indexCount = indices.size();
+
+	//write to a temporary file and rename it, so a crash never leaves a truncated cache behind
+	std::string path = CachePath(objPath);
+	std::string tmpPath = path + ".tmp";
+	FILE* f = fopen(tmpPath.c_str(), "wb");
+	if (f == NULL)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(Header), 1, f) == 1;
+	if (ok && !vertices.empty())
+		ok = fwrite(vertices.data(), sizeof(float), vertices.size(), f) == vertices.size();
+	if (ok && !indices.empty())
+		ok = fwrite(indices.data(), sizeof(uint32_t), indices.size(), f) == indices.size();
+	ok = (fclose(f) == 0) && ok;
+
+	if (!ok)
+	{
+		remove(tmpPath.c_str());
+		return false;
+	}
+
+	remove(path.c_str());
+	return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+void MeshCache::Release()
+{
+	file.Close();
+	vertices = NULL;
+	vertexFloatCount = 0;
+	indices = NULL;
+	indexCount = 0;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "MappedFile.h"
+
+//binary cache of the final vertex/index buffers built by GLWindowManager::LoadModel.
+//the cache lives next to the obj (<obj>.meshcache) and is only valid for the obj size and modification time it was
+//built from. A valid cache is memory-mapped and its buffers are uploaded straight from the mapping, skipping
+//parsing, vertex deduplication and tangent generation.
+class MeshCache
+{
+public:
+	//bump whenever the layout of the cached buffers (or of the header) changes
+	static const uint32_t VERSION = 3;
+
+	//bits for the flags parameter: anything that changes the output of LoadModel for the same obj
+	enum Flags { RANDOM_COLORS = 1, UNOPTIMIZED = 2 };
+
+	MeshCache();
+	~MeshCache();
+
+	//maps and validates the cache of objPath. Returns false (and keeps nothing mapped) if it is missing or stale
+	bool Load(const char* objPath, uint32_t flags, uint32_t floatsPerVertex);
+
+	//writes the cache of objPath. Returns false on io error
+	static bool Store(const char* objPath, uint32_t flags, uint32_t floatsPerVertex, const std::vector<float>& vertices, const std::vector<uint32_t>& indices);
+
+	//unmaps the file. Pointers returned below are invalid afterwards
+	void Release();
+
+	bool IsLoaded() const { return file.IsOpen(); }
+	const float* Vertices() const { return vertices; }
+	size_t VertexFloatCount() const { return vertexFloatCount; }
+	const uint32_t* Indices() const { return indices; }
+	size_t IndexCount() const { return indexCount; }
+
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t flags;
+		uint32_t floatsPerVertex;
+		uint64_t objSize;
+		int64_t objMtime;
+		uint64_t vertexFloatCount;
+		uint64_t indexCount;
+	};
+
+	MappedFile file;
+
+	const float* vertices;
+	size_t vertexFloatCount;
+	const uint32_t* indices;
+	size_t indexCount;
+};
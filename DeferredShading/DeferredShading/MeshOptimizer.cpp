@@ -0,0 +1,343 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+
+#include <glm/glm.hpp>
+
+#include "MeshOptimizer.h"
+
+using namespace std;
+
+static const uint32_t INVALID_VERTEX = 0xFFFFFFFFu;
+
+//FIFO cache simulation shared by the statistics and the overdraw clustering: a vertex is in the cache while fewer than
+//cacheSize misses happened since its own. Adding cacheSize + 1 to time empties it
+struct FifoCache
+{
+	std::vector<uint32_t> missTime;
+	uint32_t time;
+	unsigned size;
+
+	FifoCache(size_t vertexCount, unsigned cacheSize) : missTime(vertexCount, 0), time(cacheSize + 1), size(cacheSize) {}
+
+	//true on a miss
+	bool Access(uint32_t vertex)
+	{
+		if (time - missTime[vertex] <= size)
+			return false;
+		missTime[vertex] = time++;
+		return true;
+	}
+
+	void Clear()
+	{
+		time += size + 1;
+	}
+};
+
+VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize)
+{
+	VertexCacheStatistics statistics = { 0.0f, 0.0f };
+	if (indices.empty())
+		return statistics;
+
+	FifoCache cache(vertexCount, cacheSize);
+	std::vector<bool> referenced(vertexCount, false);
+	size_t misses = 0, referencedCount = 0;
+	for (uint32_t index : indices)
+	{
+		if (cache.Access(index))
+			misses++;
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			referencedCount++;
+		}
+	}
+
+	statistics.acmr = (float)misses / (indices.size() / 3);
+	statistics.atvr = (float)misses / referencedCount;
+	return statistics;
+}
+
+float AnalyzeVertexFetch(const std::vector<uint32_t>& indices, size_t vertexCount, size_t vertexSize)
+{
+	//8 KB of 64 byte lines, FIFO
+	const unsigned CACHE_LINES = 128;
+	if (indices.empty())
+		return 0.0f;
+
+	FifoCache cache((vertexCount * vertexSize + 63) / 64, CACHE_LINES);
+	std::vector<bool> referenced(vertexCount, false);
+	size_t lineMisses = 0, referencedCount = 0;
+	for (uint32_t index : indices)
+	{
+		size_t first = index * vertexSize / 64, last = (index * vertexSize + vertexSize - 1) / 64;
+		for (size_t line = first; line <= last; line++)
+		{
+			if (cache.Access((uint32_t)line))
+				lineMisses++;
+		}
+		if (!referenced[index])
+		{
+			referenced[index] = true;
+			referencedCount++;
+		}
+	}
+	return (float)(lineMisses * 64) / (referencedCount * vertexSize);
+}
+
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& clusterStarts, unsigned cacheSize)
+{
+	const size_t triangleCount = indices.size() / 3;
+	clusterStarts.clear();
+	if (triangleCount == 0)
+		return;
+
+	//live: triangles of each vertex not emitted yet. adjacency[offsets[v]..offsets[v + 1]): all triangles of vertex v
+	std::vector<uint32_t> live(vertexCount, 0);
+	for (uint32_t index : indices)
+		live[index]++;
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + live[v];
+	std::vector<uint32_t> adjacency(indices.size());
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < indices.size(); i++)
+		adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+	std::vector<uint32_t> cacheTime(vertexCount, 0);
+	uint32_t time = cacheSize + 1;
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<uint32_t> deadEnd; //emitted vertices, most recent on top
+	deadEnd.reserve(indices.size());
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	size_t cursor = 0; //vertices below it have no live triangles
+
+	uint32_t fanning = indices[0];
+	bool restarted = true;
+	while (fanning != INVALID_VERTEX)
+	{
+		//emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (uint32_t a = offsets[fanning]; a < offsets[fanning + 1]; a++)
+		{
+			uint32_t triangle = adjacency[a];
+			if (emitted[triangle])
+				continue;
+			if (restarted)
+			{
+				clusterStarts.push_back((uint32_t)(result.size() / 3));
+				restarted = false;
+			}
+			for (int k = 0; k < 3; k++)
+			{
+				uint32_t v = indices[triangle * 3 + k];
+				result.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				live[v]--;
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[triangle] = true;
+		}
+
+		//next: the candidate that entered the cache longest ago and will still be there after its own fan is emitted
+		//(at most 2 misses per live triangle)
+		uint32_t next = INVALID_VERTEX;
+		int best = -1;
+		for (uint32_t v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+			int priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = (int)(time - cacheTime[v]);
+			if (priority > best)
+			{
+				best = priority;
+				next = v;
+			}
+		}
+
+		if (next == INVALID_VERTEX)
+		{
+			//dead end: the most recent vertex with triangles left, else the next one in input order
+			while (!deadEnd.empty() && next == INVALID_VERTEX)
+			{
+				uint32_t v = deadEnd.back();
+				deadEnd.pop_back();
+				if (live[v] > 0)
+					next = v;
+			}
+			while (next == INVALID_VERTEX && cursor < vertexCount)
+			{
+				if (live[cursor] > 0)
+					next = (uint32_t)cursor;
+				cursor++;
+			}
+			//restarting outside the cache begins a new cluster
+			restarted = next != INVALID_VERTEX && time - cacheTime[next] > cacheSize;
+		}
+		fanning = next;
+	}
+
+	indices.swap(result);
+}
+
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const float* positions, size_t positionStride, size_t vertexCount,
+	const std::vector<uint32_t>& clusterStarts, float threshold, unsigned cacheSize)
+{
+	const size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0 || clusterStarts.empty())
+		return;
+
+	//soft boundaries: each cluster, drawn from a cold cache, is split where it has already paid for its misses
+	FifoCache cache(vertexCount, cacheSize);
+	auto triangleMisses = [&](size_t triangle)
+	{
+		int misses = 0;
+		for (int k = 0; k < 3; k++)
+			misses += cache.Access(indices[triangle * 3 + k]) ? 1 : 0;
+		return misses;
+	};
+	std::vector<uint32_t> clusters;
+	for (size_t c = 0; c < clusterStarts.size(); c++)
+	{
+		size_t begin = clusterStarts[c];
+		size_t end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+
+		cache.Clear();
+		size_t clusterMisses = 0;
+		for (size_t t = begin; t < end; t++)
+			clusterMisses += triangleMisses(t);
+		float clusterAcmr = (float)clusterMisses / (end - begin);
+
+		cache.Clear();
+		clusters.push_back((uint32_t)begin);
+		size_t start = begin, misses = 0;
+		for (size_t t = begin; t < end; t++)
+		{
+			misses += triangleMisses(t);
+			if (t + 1 < end && misses <= threshold * clusterAcmr * (t + 1 - start))
+			{
+				clusters.push_back((uint32_t)(t + 1));
+				start = t + 1;
+				misses = 0;
+				cache.Clear();
+			}
+		}
+	}
+
+	//sort key: how far each cluster lies out of the mesh along its own normal. Centroids and normals are area weighted
+	auto position = [&](uint32_t v) { return glm::vec3(positions[v * positionStride], positions[v * positionStride + 1], positions[v * positionStride + 2]); };
+	std::vector<glm::vec3> centroids(clusters.size()), normals(clusters.size());
+	std::vector<float> areas(clusters.size(), 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		glm::vec3 centroid(0.0f), normal(0.0f);
+		float area = 0.0f;
+		for (size_t t = clusters[c]; t < end; t++)
+		{
+			glm::vec3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), c2 = position(indices[t * 3 + 2]);
+			glm::vec3 n = glm::cross(b - a, c2 - a);
+			float triangleArea = glm::length(n);
+			normal += n;
+			centroid += (a + b + c2) * (triangleArea / 3.0f);
+			area += triangleArea;
+		}
+		centroids[c] = centroid;
+		normals[c] = normal;
+		areas[c] = area;
+		meshCentroid += centroid;
+		meshArea += area;
+	}
+	if (meshArea > 0.0f)
+		meshCentroid /= meshArea;
+
+	std::vector<float> keys(clusters.size(), 0.0f);
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		float length = glm::length(normals[c]);
+		if (areas[c] > 0.0f && length > 0.0f)
+			keys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / length);
+	}
+
+	std::vector<uint32_t> order(clusters.size());
+	for (size_t c = 0; c < order.size(); c++)
+		order[c] = (uint32_t)c;
+	std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return keys[a] > keys[b]; });
+
+	std::vector<uint32_t> result;
+	result.reserve(indices.size());
+	for (uint32_t c : order)
+	{
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangleCount;
+		result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + end * 3);
+	}
+	indices.swap(result);
+}
+
+void OptimizeVertexFetch(std::vector<float>& vertices, size_t floatsPerVertex, std::vector<uint32_t>& indices)
+{
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	std::vector<uint32_t> remap(vertexCount, INVALID_VERTEX);
+	uint32_t next = 0;
+	for (uint32_t& index : indices)
+	{
+		if (remap[index] == INVALID_VERTEX)
+			remap[index] = next++;
+		index = remap[index];
+	}
+
+	std::vector<float> result((size_t)next * floatsPerVertex);
+	for (size_t v = 0; v < vertexCount; v++)
+	{
+		if (remap[v] != INVALID_VERTEX)
+			memcpy(&result[remap[v] * floatsPerVertex], &vertices[v * floatsPerVertex], floatsPerVertex * sizeof(float));
+	}
+	vertices.swap(result);
+}
+
+void OptimizeMesh(std::vector<float>& vertices, size_t floatsPerVertex, std::vector<uint32_t>& indices)
+{
+	size_t vertexCount = vertices.size() / floatsPerVertex;
+	if (indices.empty() || vertexCount == 0)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	auto report = [&](const char* step, const VertexCacheStatistics& before)
+	{
+		VertexCacheStatistics after = AnalyzeVertexCache(indices, vertices.size() / floatsPerVertex);
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+		printf("  %-13s ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (%.2f ms)\n", step, before.acmr, after.acmr, before.atvr, after.atvr, elapsed.count());
+		start = std::chrono::high_resolution_clock::now();
+		return after;
+	};
+
+	printf("mesh optimization, %d triangles, FIFO cache of %u vertices:\n", (int)(indices.size() / 3), VERTEX_CACHE_SIZE);
+	VertexCacheStatistics statistics = AnalyzeVertexCache(indices, vertexCount);
+	start = std::chrono::high_resolution_clock::now();
+
+	std::vector<uint32_t> clusterStarts;
+	OptimizeVertexCache(indices, vertexCount, clusterStarts);
+	statistics = report("vertex cache:", statistics);
+
+	OptimizeOverdraw(indices, vertices.data(), floatsPerVertex, vertexCount, clusterStarts);
+	statistics = report("overdraw:", statistics);
+
+	float overfetchBefore = AnalyzeVertexFetch(indices, vertexCount, floatsPerVertex * sizeof(float));
+	start = std::chrono::high_resolution_clock::now();
+	OptimizeVertexFetch(vertices, floatsPerVertex, indices);
+	report("vertex fetch:", statistics);
+	printf("  overfetch %.3f -> %.3f, %d of %d vertices used\n", overfetchBefore,
+		AnalyzeVertexFetch(indices, vertices.size() / floatsPerVertex, floatsPerVertex * sizeof(float)),
+		(int)(vertices.size() / floatsPerVertex), (int)vertexCount);
+}
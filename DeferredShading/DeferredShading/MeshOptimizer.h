@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+//triangle and vertex order of indexed triangle lists, for the post-transform vertex cache, overdraw and vertex fetch.
+//Meant to run once, when LoadModel builds the buffers that go into the mesh cache
+
+//post-transform cache entries assumed by the optimizer and the statistics (a FIFO, as on most current gpus)
+const unsigned VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStatistics
+{
+	float acmr; //average cache miss ratio: vertex shader invocations per triangle, 0.5 at best on large meshes, 3 at worst
+	float atvr; //average transformed vertex ratio: invocations per referenced vertex, 1 at best
+};
+
+//simulates a FIFO post-transform cache of cacheSize vertices over the triangle list
+VertexCacheStatistics AnalyzeVertexCache(const std::vector<uint32_t>& indices, size_t vertexCount, unsigned cacheSize = VERTEX_CACHE_SIZE);
+
+//bytes read from a vertex buffer of vertexSize byte vertices through a small cache of 64 byte lines, over the bytes of
+//the vertices referenced: 1 at best, when every line is read once
+float AnalyzeVertexFetch(const std::vector<uint32_t>& indices, size_t vertexCount, size_t vertexSize);
+
+//reorders the triangles for the post-transform cache with Tipsify (Sander, Nehab and Barczak, "Fast Triangle Reordering
+//for Vertex Locality and Reduced Overdraw", 2007): fans around the vertex whose neighbours will still be in the cache,
+//in linear time. clusterStarts receives the first triangle of every run the fanning had to restart somewhere outside
+//the cache, the hard boundaries OptimizeOverdraw may move triangles across without losing cache locality
+void OptimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexCount, std::vector<uint32_t>& clusterStarts, unsigned cacheSize = VERTEX_CACHE_SIZE);
+
+//view independent overdraw reduction, from the same paper: the clusters are split further wherever the ACMR so far is
+//within threshold (1.05: 5% more misses) of the whole cluster's, then sorted so that those facing out of the mesh,
+//which tend to occlude the others from any direction, are drawn first. positions: x, y, z at the start of every
+//vertex, positionStride floats apart
+void OptimizeOverdraw(std::vector<uint32_t>& indices, const float* positions, size_t positionStride, size_t vertexCount,
+	const std::vector<uint32_t>& clusterStarts, float threshold = 1.05f, unsigned cacheSize = VERTEX_CACHE_SIZE);
+
+//renumbers the vertices in the order the triangles first use them, so the vertex fetch walks the buffer forward, and
+//reorders vertices (floatsPerVertex floats each) to match. Vertices no triangle uses are dropped
+void OptimizeVertexFetch(std::vector<float>& vertices, size_t floatsPerVertex, std::vector<uint32_t>& indices);
+
+//the three steps above, printing ACMR and ATVR (and, for the last step, the overfetch) before and after each
+void OptimizeMesh(std::vector<float>& vertices, size_t floatsPerVertex, std::vector<uint32_t>& indices);
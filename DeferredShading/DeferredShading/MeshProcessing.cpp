@@ -0,0 +1,681 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/hash.hpp>
+
+#include "MeshProcessing.h"
+#include "ObjLoader.h"
+#include "ThreadPool.h"
+
+using namespace std;
+
+void ParallelFor(size_t count, size_t minPerThread, const std::function<void(size_t, size_t)>& fn)
+{
+	ThreadPool& pool = ThreadPool::Shared();
+	size_t nThreads = min((size_t)pool.ThreadCount(), max((size_t)1, count / max(minPerThread, (size_t)1)));
+
+	if (nThreads <= 1)
+	{
+		fn(0, count);
+		return;
+	}
+
+	//one chunk per thread, the same ranges as the threads this used to start on each call
+	pool.ParallelFor(count, (count + nThreads - 1) / nThreads, fn);
+}
+
+void GatherCorners(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, std::vector<Vertex>& corners)
+{
+	size_t nCorners = 0;
+	for (const auto& shape : shapes)
+	{
+		nCorners += shape.mesh.indices.size();
+	}
+
+	corners.resize(nCorners);
+	size_t offset = 0;
+	for (const auto& shape : shapes)
+	{
+		ParallelFor(shape.mesh.indices.size(), 65536, [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; i++)
+			{
+				const tinyobj::index_t& index = shape.mesh.indices[i];
+				//tinyobj triangulates, so every three corners are a triangle
+				glm::vec3 pos = glm::vec3(attrib.vertices[index.vertex_index * 3], attrib.vertices[index.vertex_index * 3 + 1], attrib.vertices[index.vertex_index * 3 + 2]);
+				glm::vec3 color = glm::vec3(attrib.colors[index.vertex_index*3], attrib.colors[index.vertex_index*3 + 1], attrib.colors[index.vertex_index*3 + 2]);
+				glm::vec3 normal = glm::vec3(attrib.normals[index.normal_index*3], attrib.normals[index.normal_index*3 + 1], attrib.normals[index.normal_index*3 + 2]);
+				glm::vec2 texcoord = glm::vec2(attrib.texcoords[index.texcoord_index*2], attrib.texcoords[index.texcoord_index*2 + 1]);
+				corners[offset + i] = {
+					pos, color, normal, texcoord, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f)
+				};
+			}
+		});
+		offset += shape.mesh.indices.size();
+	}
+}
+
+//bit pattern of a float for hashing. Adding 0 turns -0 into +0, since they compare equal
+static inline uint32_t FloatBits(float f)
+{
+	f += 0.0f;
+	uint32_t bits;
+	memcpy(&bits, &f, sizeof(bits));
+	return bits;
+}
+
+static inline uint64_t Mix(uint64_t h, uint64_t v)
+{
+	h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+	return h;
+}
+
+//hashes the fields used by Vertex::operator==, finalized with murmur3's fmix64 so every bit is well distributed
+static inline uint64_t HashVertex(const Vertex& v)
+{
+	uint64_t h = 0;
+	h = Mix(h, ((uint64_t)FloatBits(v.position.x) << 32) | FloatBits(v.position.y));
+	h = Mix(h, ((uint64_t)FloatBits(v.position.z) << 32) | FloatBits(v.color.x));
+	h = Mix(h, ((uint64_t)FloatBits(v.color.y) << 32) | FloatBits(v.color.z));
+	h = Mix(h, ((uint64_t)FloatBits(v.texcoord.x) << 32) | FloatBits(v.texcoord.y));
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ull;
+	h ^= h >> 33;
+	return h;
+}
+
+void DeduplicateVertices(const std::vector<Vertex>& corners, std::vector<Vertex>& uniqueVertices, std::vector<uint32_t>& indices)
+{
+	const size_t n = corners.size();
+	const uint32_t EMPTY = 0xFFFFFFFFu;
+
+	uniqueVertices.clear();
+	indices.resize(n);
+	if (n == 0)
+		return;
+
+	//partitions are selected by the top bits of the hash, the table slot by the low bits
+	size_t nThreads = ThreadPool::Shared().ThreadCount();
+	int partitionBits = 0;
+	while ((size_t(1) << partitionBits) < nThreads && n >= ((size_t)65536 << partitionBits))
+		partitionBits++;
+	const size_t nPartitions = size_t(1) << partitionBits;
+
+	std::vector<uint64_t> hashes(n);
+	ParallelFor(n, 65536, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			hashes[i] = HashVertex(corners[i]);
+	});
+
+	//corners bucketed by partition with a counting sort on the top hash bits. Every chunk of corners counts, then
+	//scatters, its own share of each bucket, so buckets keep corner order and the first occurrence still wins
+	std::vector<uint32_t> bucketed;
+	std::vector<size_t> bucketStart(nPartitions + 1, 0);
+	bucketStart[1] = n;
+	if (nPartitions > 1)
+	{
+		const size_t nChunks = nPartitions, chunk = (n + nChunks - 1) / nChunks;
+		std::vector<size_t> offsets(nChunks * nPartitions, 0); //[chunk][partition]
+		ParallelFor(nChunks, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; c++)
+				for (size_t i = c * chunk; i < min(n, (c + 1) * chunk); i++)
+					offsets[c * nPartitions + (hashes[i] >> (64 - partitionBits))]++;
+		});
+		size_t total = 0;
+		for (size_t p = 0; p < nPartitions; p++)
+		{
+			bucketStart[p] = total;
+			for (size_t c = 0; c < nChunks; c++)
+			{
+				size_t count = offsets[c * nPartitions + p];
+				offsets[c * nPartitions + p] = total;
+				total += count;
+			}
+		}
+		bucketStart[nPartitions] = total;
+
+		bucketed.resize(n);
+		ParallelFor(nChunks, 1, [&](size_t begin, size_t end)
+		{
+			for (size_t c = begin; c < end; c++)
+				for (size_t i = c * chunk; i < min(n, (c + 1) * chunk); i++)
+					bucketed[offsets[c * nPartitions + (hashes[i] >> (64 - partitionBits))]++] = (uint32_t)i;
+		});
+	}
+
+	//representative[i]: position of the first corner equal to corner i
+	std::vector<uint32_t> representative(n);
+
+	auto dedupPartition = [&](size_t partition)
+	{
+		//the bucket size is known, so the table is allocated once
+		const size_t first = bucketStart[partition], last = bucketStart[partition + 1];
+		size_t capacity = 16;
+		while (capacity < (last - first) * 2)
+			capacity <<= 1;
+		const size_t mask = capacity - 1;
+		std::vector<uint32_t> table(capacity, EMPTY);
+
+		//linear probing, in corner order, so the first occurrence always wins
+		for (size_t k = first; k < last; k++)
+		{
+			size_t i = nPartitions > 1 ? bucketed[k] : k;
+			uint64_t h = hashes[i];
+			size_t slot = (size_t)h & mask;
+			while (true)
+			{
+				uint32_t entry = table[slot];
+				if (entry == EMPTY)
+				{
+					table[slot] = (uint32_t)i;
+					representative[i] = (uint32_t)i;
+					break;
+				}
+				if (hashes[entry] == h && corners[entry] == corners[i])
+				{
+					representative[i] = entry;
+					break;
+				}
+				slot = (slot + 1) & mask;
+			}
+		}
+	};
+
+	ParallelFor(nPartitions, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t p = begin; p < end; p++)
+			dedupPartition(p);
+	});
+
+	//number the unique vertices in order of first occurrence. representative[i] <= i, so it is already numbered
+	uniqueVertices.reserve(n / 2);
+	for (size_t i = 0; i < n; i++)
+	{
+		uint32_t r = representative[i];
+		if (r == i)
+		{
+			indices[i] = (uint32_t)uniqueVertices.size();
+			uniqueVertices.push_back(corners[i]);
+		}
+		else
+		{
+			indices[i] = indices[r];
+		}
+	}
+}
+
+//the hash LoadModel used with std::unordered_map before DeduplicateVertices
+struct ReferenceVertexHash
+{
+	size_t operator()(const Vertex& vertex) const
+	{
+		return ((std::hash<glm::vec3>()(vertex.position) ^ (std::hash<glm::vec3>()(vertex.color) << 1)) >> 1) ^
+			(std::hash<glm::vec2>()(vertex.texcoord) << 1);
+	}
+};
+
+void RunDedupBenchmark(size_t nTriangles)
+{
+	//side x side cells of two triangles. uvs restart every 16 cells, so corners on those seams do not merge
+	size_t side = max((size_t)1, (size_t)sqrt(nTriangles / 2.0));
+	std::vector<Vertex> corners;
+	corners.reserve(side * side * 6);
+	for (size_t y = 0; y < side; y++)
+	{
+		for (size_t x = 0; x < side; x++)
+		{
+			const int cell[6][2] = { { 0, 0 }, { 1, 0 }, { 0, 1 }, { 1, 0 }, { 1, 1 }, { 0, 1 } };
+			for (int c = 0; c < 6; c++)
+			{
+				size_t cx = x + cell[c][0], cy = y + cell[c][1];
+				Vertex v;
+				v.position = glm::vec3((float)cx, (float)cy, sin(cx * 0.1f) * cos(cy * 0.1f));
+				v.color = glm::vec3(1.0f);
+				v.normal = glm::vec3(0.0f, 0.0f, 1.0f);
+				v.texcoord = glm::vec2((cx - x / 16 * 16) / 16.0f, (cy - y / 16 * 16) / 16.0f);
+				v.tangent = glm::vec3(1.0f, 0.0f, 0.0f);
+				v.bitangent = glm::vec3(0.0f, 1.0f, 0.0f);
+				corners.push_back(v);
+			}
+		}
+	}
+	printf("%d triangles, %d corners\n", (int)(corners.size() / 3), (int)corners.size());
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::unordered_map<Vertex, uint32_t, ReferenceVertexHash> unique;
+	std::vector<Vertex> referenceVertices;
+	std::vector<uint32_t> referenceIndices;
+	referenceIndices.reserve(corners.size());
+	for (const Vertex& vertex : corners)
+	{
+		auto it = unique.find(vertex);
+		if (it == unique.end())
+		{
+			it = unique.emplace(vertex, (uint32_t)referenceVertices.size()).first;
+			referenceVertices.push_back(vertex);
+		}
+		referenceIndices.push_back(it->second);
+	}
+	std::chrono::duration<double, std::milli> referenceTime = std::chrono::high_resolution_clock::now() - start;
+
+	start = std::chrono::high_resolution_clock::now();
+	std::vector<Vertex> uniqueVertices;
+	std::vector<uint32_t> indices;
+	DeduplicateVertices(corners, uniqueVertices, indices);
+	std::chrono::duration<double, std::milli> dedupTime = std::chrono::high_resolution_clock::now() - start;
+
+	bool identical = indices == referenceIndices && uniqueVertices.size() == referenceVertices.size() &&
+		std::equal(uniqueVertices.begin(), uniqueVertices.end(), referenceVertices.begin());
+	printf("unordered_map: %.2f ms, DeduplicateVertices: %.2f ms (%.1fx), %d unique vertices, %s\n", referenceTime.count(),
+		dedupTime.count(), referenceTime.count() / dedupTime.count(), (int)uniqueVertices.size(), identical ? "identical" : "MISMATCH");
+}
+
+//angle between two edges leaving the same corner
+static float CornerAngle(glm::vec3 a, glm::vec3 b)
+{
+	float lengths = glm::length(a) * glm::length(b);
+	if (!(lengths > 0.0f))
+		return 0.0f;
+	return acos(glm::clamp(glm::dot(a, b) / lengths, -1.0f, 1.0f));
+}
+
+//any unit vector perpendicular to n, for vertices that received no tangent
+static glm::vec3 AnyPerpendicular(glm::vec3 n)
+{
+	glm::vec3 axis = fabs(n.x) < 0.9f ? glm::vec3(1.0f, 0.0f, 0.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+	return glm::normalize(axis - n * glm::dot(n, axis));
+}
+
+void GenerateTangentFrames(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	size_t nTriangles = indices.size() / 3;
+
+	//per triangle uv tangent and handedness: +1, -1, or 0 when the uvs are degenerate
+	std::vector<glm::vec3> faceTangents(nTriangles);
+	std::vector<signed char> faceSigns(nTriangles);
+	ParallelFor(nTriangles, 16384, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			const Vertex& v0 = vertices[indices[3 * t + 0]];
+			const Vertex& v1 = vertices[indices[3 * t + 1]];
+			const Vertex& v2 = vertices[indices[3 * t + 2]];
+
+			glm::vec3 deltaPos1 = v1.position - v0.position;
+			glm::vec3 deltaPos2 = v2.position - v0.position;
+			glm::vec2 deltaUV1 = v1.texcoord - v0.texcoord;
+			glm::vec2 deltaUV2 = v2.texcoord - v0.texcoord;
+
+			float det = deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x;
+			glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) / det;
+			glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) / det;
+			glm::vec3 faceNormal = glm::cross(deltaPos1, deltaPos2);
+
+			if (det == 0.0f || !std::isfinite(tangent.x + tangent.y + tangent.z + bitangent.x + bitangent.y + bitangent.z))
+			{
+				faceTangents[t] = glm::vec3(0.0f);
+				faceSigns[t] = 0;
+				continue;
+			}
+			faceTangents[t] = tangent;
+			faceSigns[t] = glm::dot(glm::cross(faceNormal, tangent), bitangent) < 0.0f ? -1 : 1;
+		}
+	});
+
+	//splits the vertices used with both handednesses: the copy takes the mirrored triangles
+	size_t nOriginal = vertices.size();
+	std::vector<unsigned char> usage(nOriginal, 0); //bit 0: used by a +1 triangle, bit 1: by a -1 triangle
+	for (size_t t = 0; t < nTriangles; t++)
+	{
+		if (faceSigns[t] == 0)
+			continue;
+		unsigned char bit = faceSigns[t] > 0 ? 1 : 2;
+		usage[indices[3 * t + 0]] |= bit;
+		usage[indices[3 * t + 1]] |= bit;
+		usage[indices[3 * t + 2]] |= bit;
+	}
+	std::vector<uint32_t> mirrored(nOriginal, UINT32_MAX);
+	for (size_t i = 0; i < nOriginal; i++)
+	{
+		if (usage[i] == 3)
+		{
+			mirrored[i] = (uint32_t)vertices.size();
+			vertices.push_back(vertices[i]);
+		}
+	}
+	size_t nVertices = vertices.size();
+	std::vector<signed char> vertexSigns(nVertices, 1);
+	for (size_t i = 0; i < nOriginal; i++)
+	{
+		if (usage[i] == 2)
+			vertexSigns[i] = -1;
+		if (mirrored[i] != UINT32_MAX)
+			vertexSigns[mirrored[i]] = -1;
+	}
+	if (nVertices != nOriginal)
+	{
+		for (size_t t = 0; t < nTriangles; t++)
+		{
+			if (faceSigns[t] >= 0)
+				continue;
+			for (int c = 0; c < 3; c++)
+			{
+				uint32_t copy = mirrored[indices[3 * t + c]];
+				if (copy != UINT32_MAX)
+					indices[3 * t + c] = copy;
+			}
+		}
+	}
+
+	//angle weighted tangent of every corner, in parallel over triangles, then summed per vertex through the
+	//vertex -> corner adjacency, in corner order so the sum is deterministic. Memory stays linear in the mesh size
+	std::vector<glm::vec3> cornerTangents(indices.size(), glm::vec3(0.0f));
+	ParallelFor(nTriangles, 16384, [&](size_t begin, size_t end)
+	{
+		for (size_t t = begin; t < end; t++)
+		{
+			if (faceSigns[t] == 0)
+				continue;
+			for (int c = 0; c < 3; c++)
+			{
+				const Vertex& v = vertices[indices[3 * t + c]];
+				const Vertex& next = vertices[indices[3 * t + (c + 1) % 3]];
+				const Vertex& prev = vertices[indices[3 * t + (c + 2) % 3]];
+
+				float normalLength2 = glm::dot(v.normal, v.normal);
+				glm::vec3 projected = faceTangents[t];
+				if (normalLength2 > 0.0f)
+					projected -= v.normal * (glm::dot(v.normal, projected) / normalLength2);
+				float length = glm::length(projected);
+				if (!(length > 0.0f))
+					continue;
+				cornerTangents[3 * t + c] = projected * (CornerAngle(next.position - v.position, prev.position - v.position) / length);
+			}
+		}
+	});
+
+	std::vector<uint32_t> cornerOffsets(nVertices + 1, 0);
+	for (uint32_t index : indices)
+		cornerOffsets[index + 1]++;
+	for (size_t i = 0; i < nVertices; i++)
+		cornerOffsets[i + 1] += cornerOffsets[i];
+	std::vector<uint32_t> vertexCorners(indices.size());
+	{
+		std::vector<uint32_t> fill(cornerOffsets.begin(), cornerOffsets.end() - 1);
+		for (size_t k = 0; k < indices.size(); k++)
+			vertexCorners[fill[indices[k]]++] = (uint32_t)k;
+	}
+
+	ParallelFor(nVertices, 65536, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			glm::vec3 tangent(0.0f);
+			for (uint32_t k = cornerOffsets[i]; k < cornerOffsets[i + 1]; k++)
+				tangent += cornerTangents[vertexCorners[k]];
+
+			Vertex& v = vertices[i];
+			glm::vec3 normal = glm::length(v.normal) > 0.0f ? glm::normalize(v.normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+			tangent -= normal * glm::dot(normal, tangent);
+			tangent = glm::length(tangent) > 1e-12f ? glm::normalize(tangent) : AnyPerpendicular(normal);
+
+			v.tangent = tangent;
+			v.bitangent = glm::cross(normal, tangent) * (float)vertexSigns[i];
+		}
+	});
+}
+
+//the per-face frames LoadModel computed before GenerateTangentFrames: the uv tangent and bitangent of every triangle,
+//averaged over the triangles of each vertex (the old code then discarded its normalize, so they are left as they are)
+static void GenerateFaceAveragedFrames(std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	std::vector<int> faces(vertices.size(), 0);
+	for (Vertex& v : vertices)
+	{
+		v.tangent = glm::vec3(0.0f);
+		v.bitangent = glm::vec3(0.0f);
+	}
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const Vertex& v0 = vertices[indices[i + 0]];
+		const Vertex& v1 = vertices[indices[i + 1]];
+		const Vertex& v2 = vertices[indices[i + 2]];
+		glm::vec3 deltaPos1 = v1.position - v0.position;
+		glm::vec3 deltaPos2 = v2.position - v0.position;
+		glm::vec2 deltaUV1 = v1.texcoord - v0.texcoord;
+		glm::vec2 deltaUV2 = v2.texcoord - v0.texcoord;
+
+		float r = 1.0f / (deltaUV1.x * deltaUV2.y - deltaUV1.y * deltaUV2.x);
+		glm::vec3 tangent = (deltaPos1 * deltaUV2.y - deltaPos2 * deltaUV1.y) * r;
+		glm::vec3 bitangent = (deltaPos2 * deltaUV1.x - deltaPos1 * deltaUV2.x) * r;
+		for (int c = 0; c < 3; c++)
+		{
+			faces[indices[i + c]]++;
+			vertices[indices[i + c]].tangent += tangent;
+			vertices[indices[i + c]].bitangent += bitangent;
+		}
+	}
+	for (size_t i = 0; i < vertices.size(); i++)
+	{
+		if (faces[i] > 0)
+		{
+			vertices[i].tangent /= (float)faces[i];
+			vertices[i].bitangent /= (float)faces[i];
+		}
+	}
+}
+
+//loads, gathers and deduplicates the corners of an obj like LoadModel does. Prints and returns false on error
+static bool LoadDeduplicatedObj(const char* objPath, std::vector<Vertex>& vertices, std::vector<uint32_t>& indices)
+{
+	tinyobj::attrib_t attrib;
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	std::string warn, err;
+	if (!LoadObjParallel(&attrib, &shapes, &materials, &warn, &err, objPath))
+	{
+		printf("failed to load %s: %s\n", objPath, (warn + err).c_str());
+		return false;
+	}
+	std::vector<Vertex> corners;
+	GatherCorners(attrib, shapes, corners);
+	DeduplicateVertices(corners, vertices, indices);
+	return true;
+}
+
+void RunTangentBenchmark(const char* objPath)
+{
+	std::vector<Vertex> vertices;
+	std::vector<uint32_t> indices;
+	if (!LoadDeduplicatedObj(objPath, vertices, indices))
+		return;
+	const int runs = 10;
+	printf("%s: %d triangles, %d vertices, best of %d runs\n", objPath, (int)(indices.size() / 3), (int)vertices.size(), runs);
+
+	double best[2] = { 1e30, 1e30 };
+	for (int run = 0; run < runs; run++)
+	{
+		for (int mode = 0; mode < 2; mode++)
+		{
+			std::vector<Vertex> v = vertices;
+			std::vector<uint32_t> i = indices;
+			auto start = std::chrono::high_resolution_clock::now();
+			if (mode == 0)
+				GenerateFaceAveragedFrames(v, i);
+			else
+				GenerateTangentFrames(v, i);
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			best[mode] = min(best[mode], elapsed.count());
+		}
+	}
+	double mtris = indices.size() / 3 / 1000000.0;
+	printf("per-face average: %.3f ms (%.1f Mtri/s)\n", best[0], mtris / (best[0] / 1000.0));
+	printf("GenerateTangentFrames: %.3f ms (%.1f Mtri/s), %u threads\n", best[1], mtris / (best[1] / 1000.0), ThreadPool::Shared().ThreadCount());
+}
+
+bool RunTangentGoldenTest(const char* objPath)
+{
+	const float MAX_DEGREES = 5.0f, MIN_PASSING = 0.99f;
+
+	std::vector<Vertex> reference, generated;
+	std::vector<uint32_t> referenceIndices, generatedIndices;
+	if (!LoadDeduplicatedObj(objPath, reference, referenceIndices))
+		return false;
+	generated = reference;
+	generatedIndices = referenceIndices;
+	GenerateFaceAveragedFrames(reference, referenceIndices);
+	GenerateTangentFrames(generated, generatedIndices);
+
+	//split vertices are left out: the old frames averaged both handednesses into them
+	std::vector<bool> split(reference.size(), false);
+	for (size_t k = 0; k < referenceIndices.size(); k++)
+	{
+		if (generatedIndices[k] != referenceIndices[k])
+			split[referenceIndices[k]] = true;
+	}
+
+	size_t compared = 0, passing = 0, skipped = 0, flipped = 0;
+	double sumDegrees = 0.0, maxDegrees = 0.0;
+	for (size_t i = 0; i < reference.size(); i++)
+	{
+		const Vertex& old = reference[i];
+		const Vertex& v = generated[i];
+		glm::vec3 normal = glm::length(v.normal) > 0.0f ? glm::normalize(v.normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+		//the old tangent, made orthogonal to the normal like the new one
+		glm::vec3 oldTangent = old.tangent - normal * glm::dot(normal, old.tangent);
+		float length = glm::length(oldTangent);
+		if (split[i] || !std::isfinite(length + old.bitangent.x + old.bitangent.y + old.bitangent.z) || !(length > 1e-12f))
+		{
+			skipped++;
+			continue;
+		}
+		oldTangent /= length;
+
+		double degrees = glm::degrees(acos(glm::clamp(glm::dot(oldTangent, v.tangent), -1.0f, 1.0f)));
+		bool sameHandedness = (glm::dot(glm::cross(normal, old.tangent), old.bitangent) < 0.0f) == (glm::dot(glm::cross(normal, v.tangent), v.bitangent) < 0.0f);
+		compared++;
+		sumDegrees += degrees;
+		maxDegrees = max(maxDegrees, degrees);
+		if (!sameHandedness)
+			flipped++;
+		if (degrees <= MAX_DEGREES && sameHandedness)
+			passing++;
+	}
+
+	bool passed = compared > 0 && passing >= MIN_PASSING * compared;
+	printf("%s: %d vertices compared, %d skipped (split or degenerate), %d split copies\n", objPath, (int)compared, (int)skipped,
+		(int)(generated.size() - reference.size()));
+	printf("tangent angle to the per-face frames: mean %.3f, max %.3f degrees; %d handedness flips\n",
+		compared > 0 ? sumDegrees / compared : 0.0, maxDegrees, (int)flipped);
+	printf("%d of %d within %.1f degrees with the same handedness: %s\n", (int)passing, (int)compared, MAX_DEGREES, passed ? "PASS" : "FAIL");
+	return passed;
+}
+
+PackedVertexFormat GetPackedVertexFormat(VertexLayout layout)
+{
+	PackedVertexFormat format;
+	unsigned int positionBytes = layout == VERTEX_LAYOUT_PACKED16 ? 4 * sizeof(uint16_t) : 3 * sizeof(float);
+	format.positionOffset = 0;
+	format.normalOffset = positionBytes;
+	format.texcoordOffset = format.normalOffset + 4;
+	format.tangentOffset = format.texcoordOffset + 4;
+	format.stride = format.tangentOffset + 4;
+	return format;
+}
+
+//octahedral encoding of a direction into [-1, 1]^2
+static glm::vec2 OctEncode(glm::vec3 n)
+{
+	float l1 = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+	if (!(l1 > 0.0f) || !std::isfinite(l1))
+		return glm::vec2(0.0f, 0.0f);
+	n /= l1;
+	glm::vec2 p(n.x, n.y);
+	if (n.z < 0.0f)
+	{
+		p = glm::vec2((1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f), (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f));
+	}
+	return p;
+}
+
+void PackVertices(const float* vertices, size_t nVertices, VertexLayout layout, std::vector<unsigned char>& packed, glm::vec3& aabbMin, glm::vec3& aabbExtent)
+{
+	const size_t FLOATS = 17;
+	PackedVertexFormat format = GetPackedVertexFormat(layout);
+	packed.resize(nVertices * format.stride);
+
+	aabbMin = glm::vec3(0.0f);
+	aabbExtent = glm::vec3(1.0f);
+	if (layout == VERTEX_LAYOUT_PACKED16 && nVertices > 0)
+	{
+		glm::vec3 lo = glm::make_vec3(vertices), hi = lo;
+		for (size_t i = 1; i < nVertices; i++)
+		{
+			glm::vec3 p = glm::make_vec3(vertices + i * FLOATS);
+			lo = glm::min(lo, p);
+			hi = glm::max(hi, p);
+		}
+		aabbMin = lo;
+		aabbExtent = hi - lo;
+		//flat axes would divide by zero
+		for (int a = 0; a < 3; a++)
+			if (!(aabbExtent[a] > 0.0f))
+				aabbExtent[a] = 1.0f;
+	}
+
+	const glm::vec3 qMin = aabbMin, qScale = 65535.0f / aabbExtent;
+	ParallelFor(nVertices, 65536, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			const float* v = vertices + i * FLOATS;
+			unsigned char* out = &packed[i * format.stride];
+
+			glm::vec3 position = glm::make_vec3(v);
+			glm::vec3 normal = glm::make_vec3(v + 6);
+			glm::vec2 texcoord = glm::make_vec2(v + 9);
+			glm::vec3 tangent = glm::make_vec3(v + 11);
+			glm::vec3 bitangent = glm::make_vec3(v + 14);
+
+			if (layout == VERTEX_LAYOUT_PACKED16)
+			{
+				glm::vec3 q = glm::clamp((position - qMin) * qScale + 0.5f, glm::vec3(0.0f), glm::vec3(65535.0f));
+				uint16_t p[4] = { (uint16_t)q.x, (uint16_t)q.y, (uint16_t)q.z, 0 };
+				memcpy(out + format.positionOffset, p, sizeof(p));
+			}
+			else
+			{
+				memcpy(out + format.positionOffset, v, 3 * sizeof(float));
+			}
+
+			//tangent made orthogonal to the normal, so that normal, tangent and the rebuilt bitangent form a proper frame
+			float nLength = glm::length(normal);
+			glm::vec3 n = nLength > 0.0f ? normal / nLength : glm::vec3(0.0f, 0.0f, 1.0f);
+			glm::vec3 t = tangent - n * glm::dot(n, tangent);
+			if (!(glm::dot(t, t) > 1e-20f) || !std::isfinite(t.x + t.y + t.z))
+			{
+				//no usable tangent: any direction orthogonal to the normal
+				t = fabsf(n.x) < 0.9f ? glm::cross(n, glm::vec3(1.0f, 0.0f, 0.0f)) : glm::cross(n, glm::vec3(0.0f, 1.0f, 0.0f));
+			}
+			float sign = glm::dot(glm::cross(n, t), bitangent) < 0.0f ? -1.0f : 1.0f;
+
+			uint32_t packedNormal = glm::packSnorm3x10_1x2(glm::vec4(OctEncode(n), 0.0f, 0.0f));
+			uint32_t packedTexcoord = glm::packHalf2x16(texcoord);
+			uint32_t packedTangent = glm::packSnorm3x10_1x2(glm::vec4(OctEncode(t), 0.0f, sign));
+			memcpy(out + format.normalOffset, &packedNormal, 4);
+			memcpy(out + format.texcoordOffset, &packedTexcoord, 4);
+			memcpy(out + format.tangentOffset, &packedTangent, 4);
+		}
+	});
+}
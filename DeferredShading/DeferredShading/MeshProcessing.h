@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <tiny_obj_loader.h>
+
+//a corner of a triangle as read from the obj, before deduplication
+struct Vertex {
+	glm::vec3 position;
+	glm::vec3 color;
+	glm::vec3 normal;
+	glm::vec2 texcoord;
+	glm::vec3 tangent;
+	glm::vec3 bitangent;
+
+	//normals, tangents and bitangents are not required to be equal
+	bool operator==(const Vertex& other) const {
+		return position == other.position && color == other.color && texcoord == other.texcoord;
+	}
+};
+
+//fills corners with every corner of every shape, in order, as read from the obj. Tangent and bitangent are left for
+//GenerateTangentFrames
+void GatherCorners(const tinyobj::attrib_t& attrib, const std::vector<tinyobj::shape_t>& shapes, std::vector<Vertex>& corners);
+
+//runs fn(begin, end) over [0, count) split in contiguous ranges, one per thread of ThreadPool::Shared().
+//runs inline when count is below minPerThread
+void ParallelFor(size_t count, size_t minPerThread, const std::function<void(size_t, size_t)>& fn);
+
+//deduplicates the corners of a mesh. uniqueVertices receives the distinct vertices in order of first occurrence and
+//indices one entry per corner, pointing into uniqueVertices (the same output as inserting the corners in order in a
+//std::unordered_map<Vertex, uint32_t>).
+//corners are hashed once, bucketed by partition (top hash bits) with a counting sort, and each bucket is
+//deduplicated by its own thread in an open addressing table sized up front.
+void DeduplicateVertices(const std::vector<Vertex>& corners, std::vector<Vertex>& uniqueVertices, std::vector<uint32_t>& indices);
+
+//deduplicates a synthetic grid of about nTriangles triangles, with uv seams, with DeduplicateVertices and with the
+//std::unordered_map loop LoadModel used before it, printing both times and checking that the outputs are identical
+void RunDedupBenchmark(size_t nTriangles);
+
+//computes per-vertex tangents and bitangents for an indexed triangle list, in the spirit of MikkTSpace:
+//each triangle's uv tangent is projected onto the tangent plane of each of its vertex normals and weighted by the
+//corner angle, triangles with degenerate uvs contribute nothing, and vertices shared by triangles of opposite uv
+//handedness (mirrored uvs) are split, appending a copy to vertices and rewriting indices. The bitangent is stored
+//as sign * cross(normal, tangent), sign being the vertex handedness.
+//corner tangents are computed in parallel over triangles and summed per vertex through a vertex -> corner adjacency.
+void GenerateTangentFrames(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+//times GenerateTangentFrames and the per-face averaged frames it replaced on the deduplicated mesh of an obj
+void RunTangentBenchmark(const char* objPath);
+
+//golden test: compares the frames of GenerateTangentFrames with the per-face averaged ones on the mesh of an obj.
+//Vertices split on mirrored uvs and those without a finite old tangent are skipped; the rest must keep their
+//handedness and stay within a few degrees. Prints the statistics and returns whether it passed
+bool RunTangentGoldenTest(const char* objPath);
+
+//compact vertex layouts, see PackVertices
+enum VertexLayout
+{
+	VERTEX_LAYOUT_FLOAT,     //17 floats: position, color, normal, uv, tangent, bitangent (68 bytes)
+	VERTEX_LAYOUT_PACKED,    //float position, octahedral normal/tangent, half uv (24 bytes)
+	VERTEX_LAYOUT_PACKED16   //same, with the position as 16-bit unorm relative to the mesh AABB (20 bytes)
+};
+
+//byte offsets of each attribute in a packed vertex
+struct PackedVertexFormat
+{
+	unsigned int stride;
+	unsigned int positionOffset;
+	unsigned int normalOffset;   //GL_INT_2_10_10_10_REV, octahedral xy
+	unsigned int texcoordOffset; //2 x GL_HALF_FLOAT
+	unsigned int tangentOffset;  //GL_INT_2_10_10_10_REV, octahedral xy, w = bitangent sign
+};
+
+PackedVertexFormat GetPackedVertexFormat(VertexLayout layout);
+
+//converts nVertices interleaved 17-float vertices into the packed layout. Color is dropped and the bitangent is
+//reduced to a sign, rebuilt in the vertex shader as sign * cross(normal, tangent). For VERTEX_LAYOUT_PACKED16,
+//aabbMin/aabbExtent receive the box the positions were quantized to (position = aabbMin + unorm * aabbExtent)
+void PackVertices(const float* vertices, size_t nVertices, VertexLayout layout, std::vector<unsigned char>& packed, glm::vec3& aabbMin, glm::vec3& aabbExtent);
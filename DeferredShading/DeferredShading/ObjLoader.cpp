@@ -0,0 +1,632 @@
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+#include "MappedFile.h"
+#include "MeshProcessing.h"
+#include "ObjLoader.h"
+#include "ThreadPool.h"
+
+//the tinyobj implementation lives in this translation unit: the parallel loader reuses its internal parsing and
+//triangulation helpers, so both paths produce bit-identical results.
+//must come after every header that includes tiny_obj_loader.h, since the implementation part has no include guard
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+
+using namespace std;
+using namespace tinyobj;
+
+//chunks smaller than this aren't worth a thread
+static const size_t MIN_CHUNK_BYTES = 1 << 20;
+
+//bits of ChunkResult::relative: which indices of a corner were relative (negative) in the file
+enum { REL_V = 1, REL_VT = 2, REL_VN = 4 };
+
+//a line that changes the parser state (usemtl, mtllib, g, o, s), replayed in order after the parallel phase
+struct StateLine
+{
+	size_t face;     //number of faces of the chunk before this line
+	size_t lineNum;  //line number inside the chunk
+	std::string line;
+};
+
+struct ChunkResult
+{
+	std::vector<real_t> v, vn, vt, vc;
+	bool foundAllColors = true;
+
+	//faces, flattened: face i has corners [faceStart[i], faceStart[i + 1])
+	std::vector<vertex_index_t> corners;
+	std::vector<unsigned char> relative;
+	std::vector<size_t> faceStart;
+
+	std::vector<StateLine> stateLines;
+	size_t nLines = 0;
+
+	bool unsupported = false; //has l, p or t lines
+	bool failed = false;
+	size_t failedLine = 0;
+};
+
+//same as parseTriple, but relative indices are resolved against the chunk-local counts and flagged, so they can be
+//rebased once the counts of the previous chunks are known
+static bool parseTripleDeferred(const char **token, int vsize, int vnsize, int vtsize, vertex_index_t *ret, unsigned char *rel)
+{
+	vertex_index_t vi(-1);
+	*rel = 0;
+
+	int idx = atoi((*token));
+	if (!fixIndex(idx, vsize, &(vi.v_idx)))
+		return false;
+	if (idx < 0)
+		*rel |= REL_V;
+
+	(*token) += strcspn((*token), "/ \t\r");
+	if ((*token)[0] != '/') {
+		(*ret) = vi;
+		return true;
+	}
+	(*token)++;
+
+	// i//k
+	if ((*token)[0] == '/') {
+		(*token)++;
+		idx = atoi((*token));
+		if (!fixIndex(idx, vnsize, &(vi.vn_idx)))
+			return false;
+		if (idx < 0)
+			*rel |= REL_VN;
+		(*token) += strcspn((*token), "/ \t\r");
+		(*ret) = vi;
+		return true;
+	}
+
+	// i/j/k or i/j
+	idx = atoi((*token));
+	if (!fixIndex(idx, vtsize, &(vi.vt_idx)))
+		return false;
+	if (idx < 0)
+		*rel |= REL_VT;
+
+	(*token) += strcspn((*token), "/ \t\r");
+	if ((*token)[0] != '/') {
+		(*ret) = vi;
+		return true;
+	}
+
+	// i/j/k
+	(*token)++;
+	idx = atoi((*token));
+	if (!fixIndex(idx, vnsize, &(vi.vn_idx)))
+		return false;
+	if (idx < 0)
+		*rel |= REL_VN;
+	(*token) += strcspn((*token), "/ \t\r");
+
+	(*ret) = vi;
+	return true;
+}
+
+//parses the lines in [begin, end). Mirrors the main loop of tinyobj::LoadObj for everything but the state lines
+static void ParseChunk(const char* begin, const char* end, ChunkResult& out)
+{
+	std::string linebuf;
+	const char* p = begin;
+	out.faceStart.push_back(0);
+
+	while (p < end)
+	{
+		//same line splitting as safeGetline: \n, \r\n or \r
+		const char* lineEnd = p;
+		while (lineEnd < end && *lineEnd != '\n' && *lineEnd != '\r')
+			lineEnd++;
+		linebuf.assign(p, lineEnd);
+		if (lineEnd < end && *lineEnd == '\r' && lineEnd + 1 < end && lineEnd[1] == '\n')
+			p = lineEnd + 2;
+		else
+			p = lineEnd + 1;
+
+		size_t lineNum = ++out.nLines;
+
+		if (linebuf.empty())
+			continue;
+
+		const char *token = linebuf.c_str();
+		token += strspn(token, " \t");
+		if (token[0] == '\0' || token[0] == '#')
+			continue;
+
+		// vertex
+		if (token[0] == 'v' && IS_SPACE((token[1]))) {
+			token += 2;
+			real_t x, y, z;
+			real_t r, g, b;
+			out.foundAllColors &= parseVertexWithColor(&x, &y, &z, &r, &g, &b, &token);
+			out.v.push_back(x);
+			out.v.push_back(y);
+			out.v.push_back(z);
+			out.vc.push_back(r);
+			out.vc.push_back(g);
+			out.vc.push_back(b);
+			continue;
+		}
+
+		// normal
+		if (token[0] == 'v' && token[1] == 'n' && IS_SPACE((token[2]))) {
+			token += 3;
+			real_t x, y, z;
+			parseReal3(&x, &y, &z, &token);
+			out.vn.push_back(x);
+			out.vn.push_back(y);
+			out.vn.push_back(z);
+			continue;
+		}
+
+		// texcoord
+		if (token[0] == 'v' && token[1] == 't' && IS_SPACE((token[2]))) {
+			token += 3;
+			real_t x, y;
+			parseReal2(&x, &y, &token);
+			out.vt.push_back(x);
+			out.vt.push_back(y);
+			continue;
+		}
+
+		// face
+		if (token[0] == 'f' && IS_SPACE((token[1]))) {
+			token += 2;
+			token += strspn(token, " \t");
+
+			while (!IS_NEW_LINE(token[0])) {
+				vertex_index_t vi;
+				unsigned char rel;
+				if (!parseTripleDeferred(&token, static_cast<int>(out.v.size() / 3),
+					static_cast<int>(out.vn.size() / 3),
+					static_cast<int>(out.vt.size() / 2), &vi, &rel)) {
+					out.failed = true;
+					out.failedLine = lineNum;
+					return;
+				}
+				out.corners.push_back(vi);
+				out.relative.push_back(rel);
+				token += strspn(token, " \t\r");
+			}
+			out.faceStart.push_back(out.corners.size());
+			continue;
+		}
+
+		// primitives this loader doesn't handle
+		if ((token[0] == 'l' || token[0] == 'p' || token[0] == 't') && IS_SPACE((token[1]))) {
+			out.unsupported = true;
+			return;
+		}
+
+		// state lines, replayed later
+		if (((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) ||
+			((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) ||
+			((token[0] == 'g' || token[0] == 'o' || token[0] == 's') && IS_SPACE((token[1])))) {
+			StateLine state;
+			state.face = out.faceStart.size() - 1;
+			state.lineNum = lineNum;
+			state.line = token;
+			out.stateLines.push_back(state);
+			continue;
+		}
+
+		// Ignore unknown command.
+	}
+}
+
+//faces accumulated for the current shape, as ranges of chunk faces sharing a smoothing group
+struct FaceRange
+{
+	const ChunkResult* chunk;
+	size_t begin, end;
+	unsigned int smoothingId;
+};
+
+static void BuildPrimGroup(const std::vector<FaceRange>& ranges, size_t first, size_t count, PrimGroup& group)
+{
+	group.faceGroup.reserve(count);
+	size_t skipped = 0;
+	for (const FaceRange& range : ranges)
+	{
+		size_t n = range.end - range.begin;
+		if (skipped + n <= first)
+		{
+			skipped += n;
+			continue;
+		}
+		size_t from = range.begin + (first > skipped ? first - skipped : 0);
+		for (size_t f = from; f < range.end && group.faceGroup.size() < count; f++)
+		{
+			face_t face;
+			face.smoothing_group_id = range.smoothingId;
+			face.vertex_indices.assign(range.chunk->corners.begin() + range.chunk->faceStart[f], range.chunk->corners.begin() + range.chunk->faceStart[f + 1]);
+			group.faceGroup.push_back(face);
+		}
+		skipped += n;
+		if (group.faceGroup.size() == count)
+			break;
+	}
+}
+
+//exportGroupsToShape over the accumulated ranges. Faces are triangulated independently, so big groups are split
+//across threads and the partial meshes concatenated in order
+static bool ExportRanges(shape_t *shape, std::vector<FaceRange>& ranges, const int material_id, const std::string &name, bool triangulate, const std::vector<real_t> &v)
+{
+	size_t total = 0;
+	for (const FaceRange& range : ranges)
+		total += range.end - range.begin;
+	if (total == 0)
+	{
+		ranges.clear();
+		return false;
+	}
+
+	const std::vector<tag_t> tags;
+	size_t nParts = min((size_t)ThreadPool::Shared().ThreadCount(), max((size_t)1, total / 65536));
+	std::vector<shape_t> parts(nParts);
+	ParallelFor(nParts, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+		{
+			size_t first = total * i / nParts;
+			size_t last = total * (i + 1) / nParts;
+			PrimGroup group;
+			BuildPrimGroup(ranges, first, last - first, group);
+			exportGroupsToShape(&parts[i], group, tags, material_id, name, triangulate, v);
+		}
+	});
+
+	shape->name = name;
+	for (shape_t& part : parts)
+	{
+		mesh_t& dst = shape->mesh;
+		dst.indices.insert(dst.indices.end(), part.mesh.indices.begin(), part.mesh.indices.end());
+		dst.num_face_vertices.insert(dst.num_face_vertices.end(), part.mesh.num_face_vertices.begin(), part.mesh.num_face_vertices.end());
+		dst.material_ids.insert(dst.material_ids.end(), part.mesh.material_ids.begin(), part.mesh.material_ids.end());
+		dst.smoothing_group_ids.insert(dst.smoothing_group_ids.end(), part.mesh.smoothing_group_ids.begin(), part.mesh.smoothing_group_ids.end());
+	}
+	shape->mesh.tags = tags;
+
+	ranges.clear();
+	return true;
+}
+
+bool LoadObjParallel(attrib_t *attrib, std::vector<shape_t> *shapes,
+	std::vector<material_t> *materials, std::string *warn,
+	std::string *err, const char *filename,
+	const char *mtl_basedir, bool triangulate,
+	bool default_vcols_fallback)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		return LoadObj(attrib, shapes, materials, warn, err, filename, mtl_basedir, triangulate, default_vcols_fallback);
+	}
+
+	attrib->vertices.clear();
+	attrib->normals.clear();
+	attrib->texcoords.clear();
+	attrib->colors.clear();
+	shapes->clear();
+
+	std::string baseDir = mtl_basedir ? mtl_basedir : "";
+	if (!baseDir.empty()) {
+#ifndef _WIN32
+		const char dirsep = '/';
+#else
+		const char dirsep = '\\';
+#endif
+		if (baseDir[baseDir.length() - 1] != dirsep) baseDir += dirsep;
+	}
+	MaterialFileReader matFileReader(baseDir);
+
+	//split in chunks ending right after a '\n', so no line (nor a \r\n pair) is cut
+	const char* data = file.Data();
+	const size_t size = file.Size();
+	size_t nChunks = max((size_t)1, min((size_t)ThreadPool::Shared().ThreadCount(), size / MIN_CHUNK_BYTES));
+	std::vector<size_t> bounds(1, 0);
+	for (size_t i = 1; i < nChunks; i++)
+	{
+		size_t pos = max(bounds.back(), size * i / nChunks);
+		while (pos < size && data[pos - 1] != '\n')
+			pos++;
+		if (pos < size)
+			bounds.push_back(pos);
+	}
+	bounds.push_back(size);
+	nChunks = bounds.size() - 1;
+
+	std::vector<ChunkResult> chunks(nChunks);
+	ParallelFor(nChunks, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t c = begin; c < end; c++)
+			ParseChunk(data + bounds[c], data + bounds[c + 1], chunks[c]);
+	});
+
+	size_t lineOffset = 0;
+	for (const ChunkResult& chunk : chunks)
+	{
+		if (chunk.unsupported)
+		{
+			file.Close();
+			return LoadObj(attrib, shapes, materials, warn, err, filename, mtl_basedir, triangulate, default_vcols_fallback);
+		}
+		if (chunk.failed)
+		{
+			if (err) {
+				std::stringstream ss;
+				ss << "Failed parse `f' line(e.g. zero value for face index. line "
+					<< lineOffset + chunk.failedLine << ".)\n";
+				(*err) += ss.str();
+			}
+			return false;
+		}
+		lineOffset += chunk.nLines;
+	}
+
+	//merge the attributes; the offsets of each chunk are also used to rebase its relative indices
+	std::vector<size_t> vOffset(nChunks + 1, 0), vnOffset(nChunks + 1, 0), vtOffset(nChunks + 1, 0);
+	bool foundAllColors = true;
+	for (size_t c = 0; c < nChunks; c++)
+	{
+		vOffset[c + 1] = vOffset[c] + chunks[c].v.size();
+		vnOffset[c + 1] = vnOffset[c] + chunks[c].vn.size();
+		vtOffset[c + 1] = vtOffset[c] + chunks[c].vt.size();
+		foundAllColors &= chunks[c].foundAllColors;
+	}
+
+	std::vector<real_t> v(vOffset[nChunks]), vn(vnOffset[nChunks]), vt(vtOffset[nChunks]), vc(vOffset[nChunks]);
+	std::vector<int> greatest(nChunks * 3, -1);
+	ParallelFor(nChunks, 1, [&](size_t begin, size_t end)
+	{
+		for (size_t c = begin; c < end; c++)
+		{
+			ChunkResult& chunk = chunks[c];
+			std::copy(chunk.v.begin(), chunk.v.end(), v.begin() + vOffset[c]);
+			std::copy(chunk.vc.begin(), chunk.vc.end(), vc.begin() + vOffset[c]);
+			std::copy(chunk.vn.begin(), chunk.vn.end(), vn.begin() + vnOffset[c]);
+			std::copy(chunk.vt.begin(), chunk.vt.end(), vt.begin() + vtOffset[c]);
+			std::vector<real_t>().swap(chunk.v);
+			std::vector<real_t>().swap(chunk.vc);
+			std::vector<real_t>().swap(chunk.vn);
+			std::vector<real_t>().swap(chunk.vt);
+
+			int vBase = int(vOffset[c] / 3), vnBase = int(vnOffset[c] / 3), vtBase = int(vtOffset[c] / 2);
+			int gv = -1, gvn = -1, gvt = -1;
+			for (size_t i = 0; i < chunk.corners.size(); i++)
+			{
+				vertex_index_t& vi = chunk.corners[i];
+				unsigned char rel = chunk.relative[i];
+				if (rel & REL_V) vi.v_idx += vBase;
+				if (rel & REL_VN) vi.vn_idx += vnBase;
+				if (rel & REL_VT) vi.vt_idx += vtBase;
+				gv = max(gv, vi.v_idx);
+				gvn = max(gvn, vi.vn_idx);
+				gvt = max(gvt, vi.vt_idx);
+			}
+			greatest[3 * c] = gv;
+			greatest[3 * c + 1] = gvn;
+			greatest[3 * c + 2] = gvt;
+		}
+	});
+
+	//replay the state lines in file order, exactly like tinyobj::LoadObj
+	std::map<std::string, int> material_map;
+	int material = -1;
+	unsigned int current_smoothing_id = 0;
+	std::string name;
+	shape_t shape;
+	std::vector<FaceRange> ranges;
+	size_t line_num = 0;
+	size_t chunkFirstLine = 0;
+
+	for (size_t c = 0; c < nChunks; c++)
+	{
+		const ChunkResult& chunk = chunks[c];
+		if (c > 0)
+			chunkFirstLine += chunks[c - 1].nLines;
+		size_t face = 0;
+		for (size_t s = 0; s <= chunk.stateLines.size(); s++)
+		{
+			size_t nextFace = s < chunk.stateLines.size() ? chunk.stateLines[s].face : chunk.faceStart.size() - 1;
+			if (nextFace > face)
+			{
+				FaceRange range = { &chunk, face, nextFace, current_smoothing_id };
+				ranges.push_back(range);
+				face = nextFace;
+			}
+			if (s == chunk.stateLines.size())
+				break;
+
+			line_num = chunkFirstLine + chunk.stateLines[s].lineNum;
+			const char* token = chunk.stateLines[s].line.c_str();
+
+			// use mtl
+			if ((0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) {
+				token += 7;
+				std::string namebuf = token;
+
+				int newMaterialId = -1;
+				if (material_map.find(namebuf) != material_map.end()) {
+					newMaterialId = material_map[namebuf];
+				}
+
+				if (newMaterialId != material) {
+					ExportRanges(&shape, ranges, material, name, triangulate, v);
+					material = newMaterialId;
+				}
+				continue;
+			}
+
+			// load mtl
+			if ((0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) {
+				token += 7;
+
+				std::vector<std::string> filenames;
+				SplitString(std::string(token), ' ', filenames);
+
+				if (filenames.empty()) {
+					if (warn) {
+						std::stringstream ss;
+						ss << "Looks like empty filename for mtllib. Use default "
+							"material (line "
+							<< line_num << ".)\n";
+						(*warn) += ss.str();
+					}
+				}
+				else {
+					bool found = false;
+					for (size_t f = 0; f < filenames.size(); f++) {
+						std::string warn_mtl;
+						std::string err_mtl;
+						bool ok = matFileReader(filenames[f].c_str(), materials, &material_map, &warn_mtl, &err_mtl);
+						if (warn && (!warn_mtl.empty())) {
+							(*warn) += warn_mtl;
+						}
+						if (err && (!err_mtl.empty())) {
+							(*err) += err_mtl;
+						}
+						if (ok) {
+							found = true;
+							break;
+						}
+					}
+
+					if (!found) {
+						if (warn) {
+							(*warn) += "Failed to load material file(s). Use default material.\n";
+						}
+					}
+				}
+				continue;
+			}
+
+			// group name
+			if (token[0] == 'g' && IS_SPACE((token[1]))) {
+				ExportRanges(&shape, ranges, material, name, triangulate, v);
+				if (shape.mesh.indices.size() > 0) {
+					shapes->push_back(shape);
+				}
+				shape = shape_t();
+
+				std::vector<std::string> names;
+				while (!IS_NEW_LINE(token[0])) {
+					std::string str = parseString(&token);
+					names.push_back(str);
+					token += strspn(token, " \t\r");
+				}
+
+				if (names.size() < 2) {
+					if (warn) {
+						std::stringstream ss;
+						ss << "Empty group name. line: " << line_num << "\n";
+						(*warn) += ss.str();
+						name = "";
+					}
+				}
+				else {
+					std::stringstream ss;
+					ss << names[1];
+					for (size_t i = 2; i < names.size(); i++) {
+						ss << " " << names[i];
+					}
+					name = ss.str();
+				}
+				continue;
+			}
+
+			// object name
+			if (token[0] == 'o' && IS_SPACE((token[1]))) {
+				if (ExportRanges(&shape, ranges, material, name, triangulate, v)) {
+					shapes->push_back(shape);
+				}
+				shape = shape_t();
+
+				token += 2;
+				name = token;
+				continue;
+			}
+
+			// smoothing group id
+			if (token[0] == 's' && IS_SPACE(token[1])) {
+				token += 2;
+				token += strspn(token, " \t");
+
+				if (token[0] == '\0') {
+					continue;
+				}
+				if (token[0] == '\r' || token[1] == '\n') {
+					continue;
+				}
+
+				if (strlen(token) >= 3) {
+					if (token[0] == 'o' && token[1] == 'f' && token[2] == 'f') {
+						current_smoothing_id = 0;
+					}
+				}
+				else {
+					int smGroupId = parseInt(&token);
+					if (smGroupId < 0) {
+						current_smoothing_id = 0;
+					}
+					else {
+						current_smoothing_id = static_cast<unsigned int>(smGroupId);
+					}
+				}
+				continue;
+			}
+		}
+	}
+
+	line_num = lineOffset;
+
+	if (!foundAllColors && !default_vcols_fallback) {
+		vc.clear();
+	}
+
+	int greatest_v_idx = -1, greatest_vn_idx = -1, greatest_vt_idx = -1;
+	for (size_t c = 0; c < nChunks; c++)
+	{
+		greatest_v_idx = max(greatest_v_idx, greatest[3 * c]);
+		greatest_vn_idx = max(greatest_vn_idx, greatest[3 * c + 1]);
+		greatest_vt_idx = max(greatest_vt_idx, greatest[3 * c + 2]);
+	}
+	if (greatest_v_idx >= static_cast<int>(v.size() / 3)) {
+		if (warn) {
+			std::stringstream ss;
+			ss << "Vertex indices out of bounds (line " << line_num << ".)\n" << std::endl;
+			(*warn) += ss.str();
+		}
+	}
+	if (greatest_vn_idx >= static_cast<int>(vn.size() / 3)) {
+		if (warn) {
+			std::stringstream ss;
+			ss << "Vertex normal indices out of bounds (line " << line_num << ".)\n" << std::endl;
+			(*warn) += ss.str();
+		}
+	}
+	if (greatest_vt_idx >= static_cast<int>(vt.size() / 2)) {
+		if (warn) {
+			std::stringstream ss;
+			ss << "Vertex texcoord indices out of bounds (line " << line_num << ".)\n" << std::endl;
+			(*warn) += ss.str();
+		}
+	}
+
+	bool ret = ExportRanges(&shape, ranges, material, name, triangulate, v);
+	if (ret || shape.mesh.indices.size()) {
+		shapes->push_back(shape);
+	}
+
+	attrib->vertices.swap(v);
+	attrib->vertex_weights.clear();
+	attrib->normals.swap(vn);
+	attrib->texcoords.swap(vt);
+	attrib->texcoord_ws.clear();
+	attrib->colors.swap(vc);
+
+	return true;
+}
@@ -0,0 +1,15 @@
+#pragma once
+#include <string>
+#include <vector>
+
+#include <tiny_obj_loader.h>
+
+//multithreaded replacement for tinyobj::LoadObj (same parameters, same output).
+//the obj is memory-mapped and split in line aligned chunks; vertex attributes and faces of each chunk are parsed in
+//parallel, merged with their indices rebased, and the shapes are then rebuilt in file order with tinyobj's own
+//triangulation. Files with lines, points or tags fall back to tinyobj::LoadObj.
+bool LoadObjParallel(tinyobj::attrib_t *attrib, std::vector<tinyobj::shape_t> *shapes,
+	std::vector<tinyobj::material_t> *materials, std::string *warn,
+	std::string *err, const char *filename,
+	const char *mtl_basedir = NULL, bool triangulate = true,
+	bool default_vcols_fallback = true);
@@ -0,0 +1,254 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+
+#include "lodepng.h"
+#include "PngBenchmark.h"
+
+using namespace std;
+
+void RunPngEncodingBenchmark(const char* imagePath)
+{
+	const int runs = 3;
+	std::vector<unsigned char> image;
+	unsigned width, height;
+	unsigned error = lodepng::decode(image, width, height, imagePath);
+	if (error)
+	{
+		cout << "decoder error " << error << ": " << lodepng_error_text(error) << endl;
+		return;
+	}
+
+	unsigned int threads = max(1u, std::thread::hardware_concurrency());
+	printf("%s: %ux%u\n", imagePath, width, height);
+	printf("settings, threads, ms, MB/s, bytes, decodes\n");
+	for (int fast = 0; fast < 2; fast++)
+	{
+		for (unsigned int deflateThreads : { 1u, threads })
+		{
+			lodepng::State state;
+			if (fast)
+				lodepng_compress_settings_init_fast(&state.encoder.zlibsettings);
+			state.encoder.zlibsettings.threads = deflateThreads;
+
+			std::vector<unsigned char> png;
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int run = 0; run < runs; run++)
+			{
+				png.clear();
+				error = lodepng::encode(png, image, width, height, state);
+			}
+			std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+			double ms = elapsed.count() / runs;
+
+			std::vector<unsigned char> decoded;
+			unsigned decodedWidth, decodedHeight;
+			bool decodes = !error && lodepng::decode(decoded, decodedWidth, decodedHeight, png) == 0 && decoded == image;
+			printf("%s, %u, %.1f, %.1f, %u, %s\n", fast ? "fast" : "default", deflateThreads, ms,
+				image.size() / (1024.0 * 1024.0) / (ms / 1000.0), (unsigned)png.size(), decodes ? "yes" : "NO");
+		}
+	}
+}
+
+void RunPngFilterBenchmark(const char* imagePath)
+{
+	const int runs = 10;
+	std::vector<unsigned char> image;
+	unsigned width, height;
+	unsigned error = lodepng::decode(image, width, height, imagePath);
+	if (error)
+	{
+		cout << "decoder error " << error << ": " << lodepng_error_text(error) << endl;
+		return;
+	}
+
+	//rgba scanlines, each filtered against the one above it, as the encoder does
+	const size_t bytewidth = 4;
+	size_t rowBytes = (size_t)width * bytewidth;
+	const double MB = image.size() * runs / (1024.0 * 1024.0);
+	printf("%s: %ux%u\n", imagePath, width, height);
+	printf("filter, scalar filter MB/s, sse2 filter MB/s, scalar unfilter MB/s, sse2 unfilter MB/s, identical\n");
+	for (unsigned char type = 0; type < 5; type++)
+	{
+		std::vector<unsigned char> filtered[2], unfiltered[2];
+		double filterMBs[2], unfilterMBs[2];
+		for (int simd = 0; simd < 2; simd++)
+		{
+			filtered[simd].resize(image.size());
+			unfiltered[simd].resize(image.size());
+
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int run = 0; run < runs; run++)
+			{
+				for (unsigned y = 0; y < height; y++)
+				{
+					lodepng_filter_scanline(&filtered[simd][y * rowBytes], &image[y * rowBytes],
+						y > 0 ? &image[(y - 1) * rowBytes] : NULL, rowBytes, bytewidth, type, simd);
+				}
+			}
+			std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+			filterMBs[simd] = MB / elapsed.count();
+
+			start = std::chrono::high_resolution_clock::now();
+			for (int run = 0; run < runs; run++)
+			{
+				for (unsigned y = 0; y < height; y++)
+				{
+					lodepng_unfilter_scanline(&unfiltered[simd][y * rowBytes], &filtered[simd][y * rowBytes],
+						y > 0 ? &unfiltered[simd][(y - 1) * rowBytes] : NULL, rowBytes, bytewidth, type, simd);
+				}
+			}
+			elapsed = std::chrono::high_resolution_clock::now() - start;
+			unfilterMBs[simd] = MB / elapsed.count();
+		}
+
+		bool identical = filtered[0] == filtered[1] && unfiltered[0] == image && unfiltered[1] == image;
+		printf("%u, %.0f, %.0f, %.0f, %.0f, %s\n", (unsigned)type, filterMBs[0], filterMBs[1], unfilterMBs[0], unfilterMBs[1],
+			identical ? "yes" : "NO");
+	}
+
+	//the whole encoder, with the default minimum sum filter choice, must write the same file either way
+	std::vector<unsigned char> png[2];
+	for (int simd = 0; simd < 2; simd++)
+	{
+		lodepng::State state;
+		state.encoder.simd_filters = simd;
+		error = lodepng::encode(png[simd], image, width, height, state);
+	}
+	printf("encoded png identical: %s\n", !error && png[0] == png[1] ? "yes" : "NO");
+}
+
+void RunChecksumBenchmark(size_t megabytes)
+{
+	const int runs = 3;
+	std::vector<unsigned char> data(megabytes * 1024 * 1024);
+	unsigned int seed = 12345;
+	for (unsigned char& byte : data)
+	{
+		seed = seed * 1664525u + 1013904223u;
+		byte = (unsigned char)(seed >> 24);
+	}
+
+	const char* levels[] = { "bytewise", "slicing-by-8 crc, sse2 adler", "pclmul crc (where available)" };
+	printf("%u MB\n", (unsigned)megabytes);
+	printf("level, crc32 MB/s, adler32 MB/s, crc32, adler32\n");
+	for (unsigned level = 0; level < 3; level++)
+	{
+		unsigned crc = 0, adler = 0;
+		auto start = std::chrono::high_resolution_clock::now();
+		for (int run = 0; run < runs; run++)
+			crc = lodepng_crc32_level(data.data(), data.size(), level);
+		std::chrono::duration<double> crcTime = std::chrono::high_resolution_clock::now() - start;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (int run = 0; run < runs; run++)
+			adler = lodepng_adler32_level(data.data(), data.size(), level);
+		std::chrono::duration<double> adlerTime = std::chrono::high_resolution_clock::now() - start;
+
+		printf("%u %s, %.0f, %.0f, %08x, %08x\n", level, levels[level], megabytes * runs / crcTime.count(),
+			megabytes * runs / adlerTime.count(), crc, adler);
+	}
+}
+
+//inflates data with the bit at a time (fast == 0) or the table driven decoder
+static unsigned Inflate(const std::vector<unsigned char>& data, unsigned fast, std::vector<unsigned char>& out)
+{
+	LodePNGDecompressSettings settings;
+	lodepng_decompress_settings_init(&settings);
+	settings.fast_inflate = fast;
+	unsigned char* buffer = NULL;
+	size_t size = 0;
+	unsigned error = lodepng_inflate(&buffer, &size, data.data(), data.size(), &settings);
+	out.assign(buffer, buffer + size);
+	free(buffer);
+	return error;
+}
+
+void RunInflateBenchmark(const std::vector<std::string>& pngPaths)
+{
+	const int runs = 3;
+	const int mutations = 500;
+	unsigned int seed = 12345;
+	auto random = [&seed]() { seed = seed * 1664525u + 1013904223u; return seed >> 8; };
+
+	printf("file, deflate bytes, inflated bytes, bit at a time MB/s, tables MB/s, identical, fuzzed streams, mismatches\n");
+	for (const std::string& path : pngPaths)
+	{
+		//the deflate stream is the concatenation of the IDAT chunks, without the 2 byte zlib header and the adler32
+		std::vector<unsigned char> file;
+		if (lodepng::load_file(file, path) != 0 || file.size() < 8)
+		{
+			cout << "could not read " << path << endl;
+			continue;
+		}
+		std::vector<unsigned char> zlib;
+		const unsigned char* end = file.data() + file.size();
+		for (const unsigned char* chunk = file.data() + 8; chunk + 12 <= end && chunk + 12 + lodepng_chunk_length(chunk) <= end;
+			chunk = lodepng_chunk_next_const(chunk))
+		{
+			if (lodepng_chunk_type_equals(chunk, "IDAT"))
+			{
+				const unsigned char* data = lodepng_chunk_data_const(chunk);
+				zlib.insert(zlib.end(), data, data + lodepng_chunk_length(chunk));
+			}
+			if (lodepng_chunk_type_equals(chunk, "IEND"))
+				break;
+		}
+		if (zlib.size() < 6)
+		{
+			cout << path << ": no image data" << endl;
+			continue;
+		}
+		std::vector<unsigned char> stream(zlib.begin() + 2, zlib.end() - 4);
+
+		std::vector<unsigned char> out[2];
+		unsigned error[2];
+		double MBs[2];
+		for (unsigned fast = 0; fast < 2; fast++)
+		{
+			auto start = std::chrono::high_resolution_clock::now();
+			for (int run = 0; run < runs; run++)
+				error[fast] = Inflate(stream, fast, out[fast]);
+			std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+			MBs[fast] = out[fast].size() * runs / (1024.0 * 1024.0) / elapsed.count();
+		}
+		bool identical = error[0] == error[1] && out[0] == out[1];
+
+		//damaged copies of the stream: both decoders must stop with the same error after the same output. Only the
+		//size is compared after error 23, a stored block past the end of the input, since lodepng grows the output
+		//before checking and leaves those bytes unwritten
+		int mismatches = 0;
+		for (int mutation = 0; mutation < mutations; mutation++)
+		{
+			std::vector<unsigned char> damaged = stream;
+			switch (random() % 3)
+			{
+			case 0:
+				damaged.resize(random() % damaged.size());
+				break;
+			case 1:
+				for (unsigned flips = 1 + random() % 4; flips > 0; flips--)
+					damaged[random() % damaged.size()] ^= (unsigned char)(1 << (random() % 8));
+				break;
+			default:
+				for (unsigned bytes = 1 + random() % 16; bytes > 0; bytes--)
+					damaged[random() % damaged.size()] = (unsigned char)random();
+				break;
+			}
+			std::vector<unsigned char> damagedOut[2];
+			unsigned damagedError[2];
+			for (unsigned fast = 0; fast < 2; fast++)
+				damagedError[fast] = Inflate(damaged, fast, damagedOut[fast]);
+			bool same = damagedError[0] == damagedError[1] && damagedOut[0].size() == damagedOut[1].size()
+				&& (damagedError[0] == 23 || damagedOut[0] == damagedOut[1]);
+			if (!same)
+				mismatches++;
+		}
+
+		printf("%s, %u, %u, %.0f, %.0f, %s, %d, %d\n", path.c_str(), (unsigned)stream.size(), (unsigned)out[1].size(),
+			MBs[0], MBs[1], identical ? "yes" : "NO", mutations, mismatches);
+	}
+}
@@ -0,0 +1,23 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//benchmarks of lodepng: the encoder presets and parallel deflate, and the optimized scanline filters, checksums and
+//inflate against the original code they replaced. Each prints a table and checks that the results are correct
+
+//encodes the image at imagePath to png with lodepng's default and fast settings, serially and with parallel deflate,
+//and prints time, size and throughput of each (checking that every result decodes back to the image)
+void RunPngEncodingBenchmark(const char* imagePath);
+
+//filters and unfilters every row of the image at imagePath (as rgba) with each png filter type, with lodepng's scalar
+//and SSE2 scanline filters, and prints the MB/s of each, checking that both give the same bytes and round trip
+void RunPngFilterBenchmark(const char* imagePath);
+
+//computes the CRC32 and Adler32 of megabytes of pseudo random data at each LODEPNG_CHECKSUM_LEVEL and prints the MB/s
+//and the checksums, which must be the same on every line
+void RunChecksumBenchmark(size_t megabytes);
+
+//inflates the image data of each png with lodepng's bit at a time and table driven decoders and prints the MB/s of
+//each, then checks on damaged copies of every stream that both decoders fail the same way
+void RunInflateBenchmark(const std::vector<std::string>& pngPaths);
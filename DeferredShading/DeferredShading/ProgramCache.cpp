@@ -0,0 +1,133 @@
+#include <cstdio>
+#include <cstring>
+
+#include <glad/glad.h>
+
+#include "ProgramCache.h"
+
+static const char PROGRAM_CACHE_MAGIC[4] = { 'D', 'S', 'P', 'C' };
+
+static std::string CachePath(const char* name)
+{
+	return std::string(name) + ".programcache";
+}
+
+//64 bit FNV-1a, continued from hash
+static uint64_t HashBytes(uint64_t hash, const char* data, size_t size)
+{
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static std::string GLString(GLenum name)
+{
+	const GLubyte* s = glGetString(name);
+	return s != NULL ? std::string((const char*)s) : std::string();
+}
+
+ProgramCache::ProgramCache()
+{
+	enabled = false;
+}
+
+void ProgramCache::Initialize(bool enable)
+{
+	GLint formats = 0;
+	glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	enabled = enable && formats > 0;
+
+	//separated so "ab" + "c" and "a" + "bc" never hash alike
+	driver = GLString(GL_VENDOR) + '\n' + GLString(GL_RENDERER) + '\n' + GLString(GL_VERSION) + '\n' + GLString(GL_SHADING_LANGUAGE_VERSION);
+}
+
+uint64_t ProgramCache::Key(const std::vector<std::string>& sources) const
+{
+	uint64_t hash = 14695981039346656037ull;
+	hash = HashBytes(hash, driver.data(), driver.size() + 1);
+	for (const std::string& source : sources)
+	{
+		uint64_t size = source.size();
+		hash = HashBytes(hash, (const char*)&size, sizeof(size));
+		hash = HashBytes(hash, source.data(), source.size());
+	}
+	return hash;
+}
+
+bool ProgramCache::Load(const char* name, uint64_t key, unsigned int program) const
+{
+	if (!enabled)
+		return false;
+
+	std::string path = CachePath(name);
+	FILE* f = fopen(path.c_str(), "rb");
+	if (f == NULL)
+		return false;
+
+	Header header;
+	std::vector<char> binary;
+	bool ok = fread(&header, sizeof(Header), 1, f) == 1 && memcmp(header.magic, PROGRAM_CACHE_MAGIC, 4) == 0
+		&& header.version == VERSION && header.key == key && header.binaryLength > 0;
+	if (ok)
+	{
+		binary.resize(header.binaryLength);
+		ok = fread(binary.data(), 1, binary.size(), f) == binary.size();
+	}
+	fclose(f);
+	if (!ok)
+		return false;
+
+	//a driver update with the same version string may still refuse the binary: that is a miss, not an error
+	glProgramBinary(program, header.binaryFormat, binary.data(), (GLsizei)binary.size());
+	GLint success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	return success == GL_TRUE;
+}
+
+bool ProgramCache::Store(const char* name, uint64_t key, unsigned int program) const
+{
+	if (!enabled)
+		return false;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+
+	Header header;
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, 4);
+	header.version = VERSION;
+	header.key = key;
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	GLsizei written = 0;
+	glGetProgramBinary(program, length, &written, &format, binary.data());
+	if (written <= 0)
+		return false;
+	header.binaryFormat = format;
+	header.binaryLength = (uint32_t)written;
+
+	//write to a temporary file and rename it, so a crash never leaves a truncated cache behind
+	std::string path = CachePath(name);
+	std::string tmpPath = path + ".tmp";
+	FILE* f = fopen(tmpPath.c_str(), "wb");
+	if (f == NULL)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(Header), 1, f) == 1;
+	if (ok)
+		ok = fwrite(binary.data(), 1, written, f) == (size_t)written;
+	ok = (fclose(f) == 0) && ok;
+
+	if (!ok)
+	{
+		remove(tmpPath.c_str());
+		return false;
+	}
+
+	remove(path.c_str());
+	return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+//on-disk cache of linked program binaries (glGetProgramBinary/glProgramBinary), one <name>.programcache file per
+//program in the working directory. A binary is only valid for the exact shader sources and the driver
+//(vendor, renderer, version) it was produced by; anything else, or a binary the driver refuses, means compiling
+//from source again.
+class ProgramCache
+{
+public:
+	//bump whenever the layout of the header changes
+	static const uint32_t VERSION = 1;
+
+	ProgramCache();
+
+	//reads the driver strings and whether the driver exposes any binary format. Needs a current context.
+	//With enabled == false (or no binary formats) Load always misses and Store does nothing
+	void Initialize(bool enabled);
+	bool IsEnabled() const { return enabled; }
+
+	//key of a program linked from these sources with the current driver
+	uint64_t Key(const std::vector<std::string>& sources) const;
+
+	//loads the cached binary of name into program and checks it links. Returns false if it is missing, stale or
+	//rejected by the driver
+	bool Load(const char* name, uint64_t key, unsigned int program) const;
+
+	//writes the binary of the linked program. Returns false on io error or if the driver gives no binary
+	bool Store(const char* name, uint64_t key, unsigned int program) const;
+
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint64_t key;
+		uint32_t binaryFormat;
+		uint32_t binaryLength;
+	};
+
+	bool enabled;
+	std::string driver;
+};
@@ -0,0 +1,331 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include "lodepng.h"
+#include "QoiCodec.h"
+
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QOI_SSE 1
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+static const unsigned char QOI_OP_INDEX = 0x00; //00xxxxxx: index
+static const unsigned char QOI_OP_DIFF = 0x40;  //01rrggbb: r, g, b differences in -2..1
+static const unsigned char QOI_OP_LUMA = 0x80;  //10gggggg rrrrbbbb: g difference in -32..31, r - g and b - g in -8..7
+static const unsigned char QOI_OP_RUN = 0xc0;   //11xxxxxx: 1 to 62 repeats of the previous pixel
+static const unsigned char QOI_OP_RGB = 0xfe;
+static const unsigned char QOI_OP_RGBA = 0xff;
+static const unsigned char QOI_MASK = 0xc0;
+
+static const int QOI_HEADER_SIZE = 14;
+static const unsigned char QOI_END[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+static const int QOI_MAX_RUN = 62;
+//bounds the decoder's allocation
+static const size_t QOI_MAX_PIXELS = 400000000;
+
+static inline uint32_t LoadPixel(const unsigned char* p)
+{
+	uint32_t pixel;
+	memcpy(&pixel, p, 4);
+	return pixel;
+}
+
+static inline int Hash(const unsigned char* p)
+{
+	return (p[0] * 3 + p[1] * 5 + p[2] * 7 + p[3] * 11) % 64;
+}
+
+static void WriteBigEndian(unsigned char* out, uint32_t value)
+{
+	out[0] = (unsigned char)(value >> 24);
+	out[1] = (unsigned char)(value >> 16);
+	out[2] = (unsigned char)(value >> 8);
+	out[3] = (unsigned char)value;
+}
+
+static uint32_t ReadBigEndian(const unsigned char* in)
+{
+	return ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | ((uint32_t)in[2] << 8) | in[3];
+}
+
+//number of pixels from first (at most end) equal to pixel
+static size_t RunLength(const unsigned char* rgba, size_t first, size_t end, uint32_t pixel)
+{
+	size_t i = first;
+#ifdef QOI_SSE
+	__m128i repeated = _mm_set1_epi32((int)pixel);
+	for (; i + 4 <= end; i += 4)
+	{
+		__m128i pixels = _mm_loadu_si128((const __m128i*)&rgba[i * 4]);
+		int equal = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(pixels, repeated)));
+		if (equal != 15)
+		{
+			//the first pixel that differs
+			while (equal & 1)
+			{
+				equal >>= 1;
+				i++;
+			}
+			return i - first;
+		}
+	}
+#endif
+	while (i < end && LoadPixel(&rgba[i * 4]) == pixel)
+		i++;
+	return i - first;
+}
+
+std::vector<unsigned char> QoiEncode(const unsigned char* rgba, int width, int height, int channels)
+{
+	size_t count = (size_t)width * height;
+	//worst case: every pixel an QOI_OP_RGBA. Left uninitialized; only the bytes written are copied out
+	std::unique_ptr<unsigned char[]> buffer(new unsigned char[QOI_HEADER_SIZE + count * 5 + sizeof(QOI_END)]);
+	unsigned char* out = buffer.get();
+
+	memcpy(out, "qoif", 4);
+	WriteBigEndian(out + 4, (uint32_t)width);
+	WriteBigEndian(out + 8, (uint32_t)height);
+	out[12] = (unsigned char)channels;
+	out[13] = 0; //srgb with linear alpha
+	out += QOI_HEADER_SIZE;
+
+	uint32_t index[64];
+	memset(index, 0, sizeof(index));
+	unsigned char previous[4] = { 0, 0, 0, 255 };
+	uint32_t previousPixel = LoadPixel(previous);
+
+	size_t i = 0;
+	while (i < count)
+	{
+		const unsigned char* p = &rgba[i * 4];
+		uint32_t pixel = LoadPixel(p);
+		if (pixel == previousPixel)
+		{
+			//flat areas (backgrounds) are common in renders: measure the whole run at once
+			size_t run = RunLength(rgba, i, count, pixel);
+			i += run;
+			for (; run >= QOI_MAX_RUN; run -= QOI_MAX_RUN)
+				*out++ = (unsigned char)(QOI_OP_RUN | (QOI_MAX_RUN - 1));
+			if (run > 0)
+				*out++ = (unsigned char)(QOI_OP_RUN | (run - 1));
+			continue;
+		}
+
+		int hash = Hash(p);
+		if (index[hash] == pixel)
+		{
+			*out++ = (unsigned char)(QOI_OP_INDEX | hash);
+		}
+		else
+		{
+			index[hash] = pixel;
+			if (p[3] == previous[3])
+			{
+				signed char dr = (signed char)(p[0] - previous[0]);
+				signed char dg = (signed char)(p[1] - previous[1]);
+				signed char db = (signed char)(p[2] - previous[2]);
+				signed char drg = (signed char)(dr - dg);
+				signed char dbg = (signed char)(db - dg);
+				if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+				{
+					*out++ = (unsigned char)(QOI_OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+				}
+				else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7)
+				{
+					*out++ = (unsigned char)(QOI_OP_LUMA | (dg + 32));
+					*out++ = (unsigned char)((drg + 8) << 4 | (dbg + 8));
+				}
+				else
+				{
+					out[0] = QOI_OP_RGB;
+					memcpy(out + 1, p, 3);
+					out += 4;
+				}
+			}
+			else
+			{
+				out[0] = QOI_OP_RGBA;
+				memcpy(out + 1, p, 4);
+				out += 5;
+			}
+		}
+		memcpy(previous, p, 4);
+		previousPixel = pixel;
+		i++;
+	}
+
+	memcpy(out, QOI_END, sizeof(QOI_END));
+	out += sizeof(QOI_END);
+	return std::vector<unsigned char>(buffer.get(), out);
+}
+
+bool QoiDecode(const unsigned char* data, size_t size, std::vector<unsigned char>& rgba, int& width, int& height)
+{
+	if (size < QOI_HEADER_SIZE + sizeof(QOI_END) || memcmp(data, "qoif", 4) != 0)
+		return false;
+	uint32_t w = ReadBigEndian(data + 4);
+	uint32_t h = ReadBigEndian(data + 8);
+	if (w == 0 || h == 0 || w > 0x7fffffff || h > 0x7fffffff || (uint64_t)w * h > QOI_MAX_PIXELS)
+		return false;
+	if (data[12] != 3 && data[12] != 4)
+		return false;
+
+	size_t count = (size_t)w * h;
+	rgba.resize(count * 4);
+	unsigned char* out = rgba.data();
+	unsigned char index[64][4];
+	memset(index, 0, sizeof(index));
+	unsigned char pixel[4] = { 0, 0, 0, 255 };
+
+	const unsigned char* in = data + QOI_HEADER_SIZE;
+	const unsigned char* end = data + size - sizeof(QOI_END);
+	size_t i = 0;
+	while (i < count)
+	{
+		if (in >= end)
+			return false;
+		unsigned char op = *in++;
+		if (op == QOI_OP_RGB)
+		{
+			if (end - in < 3)
+				return false;
+			memcpy(pixel, in, 3);
+			in += 3;
+		}
+		else if (op == QOI_OP_RGBA)
+		{
+			if (end - in < 4)
+				return false;
+			memcpy(pixel, in, 4);
+			in += 4;
+		}
+		else if ((op & QOI_MASK) == QOI_OP_INDEX)
+		{
+			memcpy(pixel, index[op], 4);
+		}
+		else if ((op & QOI_MASK) == QOI_OP_DIFF)
+		{
+			pixel[0] += ((op >> 4) & 3) - 2;
+			pixel[1] += ((op >> 2) & 3) - 2;
+			pixel[2] += (op & 3) - 2;
+		}
+		else if ((op & QOI_MASK) == QOI_OP_LUMA)
+		{
+			if (in >= end)
+				return false;
+			int dg = (op & 0x3f) - 32;
+			unsigned char second = *in++;
+			pixel[0] += dg - 8 + (second >> 4);
+			pixel[1] += dg;
+			pixel[2] += dg - 8 + (second & 0x0f);
+		}
+		else
+		{
+			//QOI_OP_RUN. The pixel goes into the index too: the initial one may not be there yet
+			memcpy(index[Hash(pixel)], pixel, 4);
+			size_t run = min((size_t)(op & 0x3f) + 1, count - i);
+			for (size_t r = 0; r < run; r++)
+				memcpy(&out[(i + r) * 4], pixel, 4);
+			i += run;
+			continue;
+		}
+
+		memcpy(index[Hash(pixel)], pixel, 4);
+		memcpy(&out[i * 4], pixel, 4);
+		i++;
+	}
+
+	width = (int)w;
+	height = (int)h;
+	return true;
+}
+
+bool SaveQoi(const std::string& path, const unsigned char* rgba, int width, int height, int channels)
+{
+	std::vector<unsigned char> file = QoiEncode(rgba, width, height, channels);
+	return lodepng::save_file(file, path) == 0;
+}
+
+bool LoadQoi(const std::string& path, std::vector<unsigned char>& rgba, int& width, int& height)
+{
+	std::vector<unsigned char> file;
+	if (lodepng::load_file(file, path) != 0)
+		return false;
+	return QoiDecode(file.data(), file.size(), rgba, width, height);
+}
+
+bool ConvertQoiToPng(const std::string& qoiPath, const std::string& pngPath)
+{
+	std::vector<unsigned char> rgba;
+	int width, height;
+	if (!LoadQoi(qoiPath, rgba, width, height))
+	{
+		cout << qoiPath << ": not a qoi image" << endl;
+		return false;
+	}
+	unsigned error = lodepng::encode(pngPath, rgba, width, height);
+	if (error)
+	{
+		cout << "encoder error " << error << ": " << lodepng_error_text(error) << endl;
+		return false;
+	}
+	return true;
+}
+
+void RunQoiBenchmark(const char* imagePath)
+{
+	const int runs = 5;
+	std::vector<unsigned char> image;
+	unsigned width, height;
+	unsigned error = lodepng::decode(image, width, height, imagePath);
+	if (error)
+	{
+		cout << "decoder error " << error << ": " << lodepng_error_text(error) << endl;
+		return;
+	}
+	const double MB = image.size() * runs / (1024.0 * 1024.0);
+
+	std::vector<unsigned char> qoi;
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int run = 0; run < runs; run++)
+		qoi = QoiEncode(image.data(), width, height, 4);
+	std::chrono::duration<double> encodeTime = std::chrono::high_resolution_clock::now() - start;
+
+	std::vector<unsigned char> decoded;
+	int decodedWidth = 0, decodedHeight = 0;
+	bool valid = true;
+	start = std::chrono::high_resolution_clock::now();
+	for (int run = 0; run < runs; run++)
+		valid = QoiDecode(qoi.data(), qoi.size(), decoded, decodedWidth, decodedHeight) && valid;
+	std::chrono::duration<double> decodeTime = std::chrono::high_resolution_clock::now() - start;
+	bool exact = valid && decodedWidth == (int)width && decodedHeight == (int)height && decoded == image;
+
+	lodepng::State state;
+	lodepng_compress_settings_init_fast(&state.encoder.zlibsettings);
+	std::vector<unsigned char> png;
+	start = std::chrono::high_resolution_clock::now();
+	for (int run = 0; run < runs; run++)
+	{
+		png.clear();
+		lodepng::encode(png, image, width, height, state);
+	}
+	std::chrono::duration<double> pngTime = std::chrono::high_resolution_clock::now() - start;
+
+	start = std::chrono::high_resolution_clock::now();
+	for (int run = 0; run < runs; run++)
+		lodepng::decode(decoded, width, height, png);
+	std::chrono::duration<double> pngDecodeTime = std::chrono::high_resolution_clock::now() - start;
+
+	printf("%s: %ux%u, %u bytes of pixels\n", imagePath, width, height, (unsigned)image.size());
+	printf("format, encode MB/s, decode MB/s, bytes\n");
+	printf("qoi, %.0f, %.0f, %u\n", MB / encodeTime.count(), MB / decodeTime.count(), (unsigned)qoi.size());
+	printf("png (fast), %.0f, %.0f, %u\n", MB / pngTime.count(), MB / pngDecodeTime.count(), (unsigned)png.size());
+	printf("qoi round trip exact: %s\n", exact ? "yes" : "NO");
+}
@@ -0,0 +1,27 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+//QOI ("Quite OK Image", qoiformat.org) lossless rgba images. A single pass codes every pixel as a run of the previous
+//one, an index into a 64 entry hash table of recent pixels, a small difference to the previous pixel, or literally.
+//Many times faster than deflate, at a larger size: the frame capture format for long, high rate sequences, converted
+//to png afterwards when they should be kept
+
+//encodes a width x height rgba image, top row first, and returns the file. channels (3 or 4) only goes into the header:
+//3 tells readers that every alpha is 255. Runs are found 4 pixels at a time with SSE2 when available; the output is the
+//same as the reference encoder's
+std::vector<unsigned char> QoiEncode(const unsigned char* rgba, int width, int height, int channels);
+
+//decodes a qoi file into rgba (whatever its channels), top row first. Returns false if the data is not a valid qoi image
+bool QoiDecode(const unsigned char* data, size_t size, std::vector<unsigned char>& rgba, int& width, int& height);
+
+bool SaveQoi(const std::string& path, const unsigned char* rgba, int width, int height, int channels);
+bool LoadQoi(const std::string& path, std::vector<unsigned char>& rgba, int& width, int& height);
+
+//writes the qoi image at qoiPath as a png (lodepng's default settings, for archival). Prints and returns false on error
+bool ConvertQoiToPng(const std::string& qoiPath, const std::string& pngPath);
+
+//encodes and decodes the image at imagePath as qoi and as png (lodepng's fast preset), printing the MB/s and size of each
+//and checking that the qoi round trip is exact
+void RunQoiBenchmark(const char* imagePath);
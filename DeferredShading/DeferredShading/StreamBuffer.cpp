@@ -0,0 +1,121 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+#include "StreamBuffer.h"
+
+using namespace std;
+
+//regions start at multiples of this, which keeps every region offset a whole number of texels of any buffer texture
+//format and satisfies the usual uniform/attribute offset alignments
+static const size_t STREAM_REGION_ALIGNMENT = 256;
+
+StreamBuffer::StreamBuffer()
+{
+	buffer = 0;
+	texture = 0;
+	textureFormat = GL_NONE;
+	regionBytes = 0;
+	region = 0;
+	written = false;
+	stalls = 0;
+	fences.fill(0);
+}
+
+StreamBuffer::~StreamBuffer()
+{
+	//the buffer, the texture and the fences die with the context; nothing to release here
+}
+
+void StreamBuffer::Initialize(size_t bytes, GLenum format)
+{
+	textureFormat = format;
+	glGenBuffers(1, &buffer);
+	if (textureFormat != GL_NONE)
+		glGenTextures(1, &texture);
+	Allocate(bytes);
+}
+
+//(re)specifies the storage for STREAM_REGIONS regions of at least bytes each. The old storage is orphaned, so the
+//fences guarding it are no longer needed
+void StreamBuffer::Allocate(size_t bytes)
+{
+	for (GLsync& fence : fences)
+	{
+		if (fence != 0)
+			glDeleteSync(fence);
+		fence = 0;
+	}
+
+	regionBytes = (max(bytes, (size_t)1) + STREAM_REGION_ALIGNMENT - 1) / STREAM_REGION_ALIGNMENT * STREAM_REGION_ALIGNMENT;
+	region = 0;
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferData(GL_COPY_WRITE_BUFFER, STREAM_REGIONS * regionBytes, NULL, GL_STREAM_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (texture != 0)
+	{
+		glBindTexture(GL_TEXTURE_BUFFER, texture);
+		glTexBuffer(GL_TEXTURE_BUFFER, textureFormat, buffer);
+		glBindTexture(GL_TEXTURE_BUFFER, 0);
+	}
+}
+
+void* StreamBuffer::Map(size_t bytes)
+{
+	if (bytes > regionBytes)
+	{
+		//half again as much, so a slowly growing stream does not reallocate every frame
+		Allocate(bytes + bytes / 2);
+	}
+
+	GLsync& fence = fences[region];
+	if (fence != 0)
+	{
+		if (glClientWaitSync(fence, 0, 0) == GL_TIMEOUT_EXPIRED)
+		{
+			stalls++;
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull) == GL_TIMEOUT_EXPIRED)
+			{
+			}
+		}
+		glDeleteSync(fence);
+		fence = 0;
+	}
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	void* data = glMapBufferRange(GL_COPY_WRITE_BUFFER, region * regionBytes, bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+	if (data == NULL)
+	{
+		cerr << "StreamBuffer: glMapBufferRange failed" << endl;
+		exit(1);
+	}
+	return data;
+}
+
+size_t StreamBuffer::Unmap()
+{
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	if (glUnmapBuffer(GL_COPY_WRITE_BUFFER) == GL_FALSE)
+	{
+		cerr << "StreamBuffer: buffer contents lost while mapped" << endl;
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	size_t offset = region * regionBytes;
+	written = true;
+	region = (region + 1) % STREAM_REGIONS;
+	return offset;
+}
+
+void StreamBuffer::Fence()
+{
+	if (!written)
+		return;
+
+	int last = (region + STREAM_REGIONS - 1) % STREAM_REGIONS;
+	fences[last] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	written = false;
+}
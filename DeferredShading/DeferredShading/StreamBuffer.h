@@ -0,0 +1,55 @@
+#pragma once
+#include <array>
+#include <cstddef>
+
+#include <glad/glad.h>
+
+//ring of STREAM_REGIONS regions in a single buffer object, for data the cpu rewrites every frame (light data, tile
+//lists, instance data). Each write goes to the next region, so the gpu may still be reading the previous two while the
+//cpu fills the third. A fence is placed after the draws that read a region, and the region is only mapped again once
+//that fence has signaled; with the swap chain keeping the gpu at most a couple of frames behind, that check never
+//blocks in practice. Maps are unsynchronized (the fences replace the driver's implicit synchronization) and the
+//storage is never respecified per frame, only when a write outgrows the regions.
+//The context is GL 4.1, without ARB_buffer_storage, so regions are mapped and unmapped each frame instead of being
+//persistently mapped.
+class StreamBuffer
+{
+public:
+	static const int STREAM_REGIONS = 3;
+
+	StreamBuffer();
+	~StreamBuffer();
+
+	StreamBuffer(const StreamBuffer&) = delete;
+	StreamBuffer& operator=(const StreamBuffer&) = delete;
+
+	//creates the buffer with regionBytes per region. If textureFormat != GL_NONE a buffer texture of that format is
+	//made over the whole buffer, and readers add the texel offset of the current region to their indices
+	void Initialize(size_t regionBytes, GLenum textureFormat = GL_NONE);
+
+	//maps bytes (> 0) of the next region for writing, growing the regions if they are too small.
+	//At most one Map/Unmap between two Fence calls
+	void* Map(size_t bytes);
+	//unmaps and returns the byte offset of the data just written
+	size_t Unmap();
+	//fences the region written since the last call, once the draws that read it have been issued. No-op if nothing
+	//was written
+	void Fence();
+
+	unsigned int Buffer() const { return buffer; }
+	unsigned int Texture() const { return texture; }
+	//number of Map calls that found their region still in use by the gpu and had to wait
+	int Stalls() const { return stalls; }
+
+private:
+	unsigned int buffer;
+	unsigned int texture;
+	GLenum textureFormat;
+	size_t regionBytes;
+	int region;
+	bool written;
+	int stalls;
+	std::array<GLsync, STREAM_REGIONS> fences;
+
+	void Allocate(size_t bytes);
+};
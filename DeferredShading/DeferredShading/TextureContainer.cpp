@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+#include "stb_image.h"
+#include "TextureContainer.h"
+
+using namespace std;
+
+static const char TEXTURE_CONTAINER_MAGIC[4] = { 'D', 'S', 'T', 'X' };
+
+static std::string ContainerPath(const char* imagePath)
+{
+	return std::string(imagePath) + ".dstex";
+}
+
+static size_t LevelSize(int width, int height, int components, BlockFormat format)
+{
+	if (format == BLOCK_FORMAT_NONE)
+		return (size_t)width * height * components;
+	return CompressedSize(format, width, height);
+}
+
+//bytes of the whole mip chain of a width x height image
+static size_t ChainSize(int width, int height, int components, BlockFormat format)
+{
+	size_t size = 0;
+	while (true)
+	{
+		size += LevelSize(width, height, components, format);
+		if (width == 1 && height == 1)
+			return size;
+		width = max(1, width / 2);
+		height = max(1, height / 2);
+	}
+}
+
+//sRGB byte -> linear, for all 256 values
+static const float* SrgbToLinearTable()
+{
+	static const std::vector<float> table = []
+	{
+		std::vector<float> values(256);
+		for (int i = 0; i < 256; i++)
+		{
+			float c = i / 255.0f;
+			values[i] = c <= 0.04045f ? c / 12.92f : pow((c + 0.055f) / 1.055f, 2.4f);
+		}
+		return values;
+	}();
+	return table.data();
+}
+
+static unsigned char LinearToSrgb(float linear)
+{
+	linear = min(max(linear, 0.0f), 1.0f);
+	float c = linear <= 0.0031308f ? linear * 12.92f : 1.055f * pow(linear, 1.0f / 2.4f) - 0.055f;
+	return (unsigned char)(c * 255.0f + 0.5f);
+}
+
+//rows [rowBegin, rowEnd) of the level below src, each texel the average of (up to) 2x2 source texels. Odd sizes
+//repeat the last row/column
+static void Downsample(const unsigned char* src, int srcWidth, int srcHeight, unsigned char* dst, int dstWidth,
+	int components, uint32_t flags, size_t rowBegin, size_t rowEnd)
+{
+	const float* toLinear = SrgbToLinearTable();
+	//alpha (the last channel of 2 and 4 channel images) is not color
+	int colorChannels = (components == 2 || components == 4) ? components - 1 : components;
+	bool normalMap = (flags & TextureContainer::NORMAL_MAP) && colorChannels == 3;
+
+	for (size_t y = rowBegin; y < rowEnd; y++)
+	{
+		const unsigned char* rows[2] = {
+			src + (size_t)min(2 * (int)y, srcHeight - 1) * srcWidth * components,
+			src + (size_t)min(2 * (int)y + 1, srcHeight - 1) * srcWidth * components };
+		unsigned char* out = dst + y * dstWidth * components;
+
+		for (int x = 0; x < dstWidth; x++, out += components)
+		{
+			int x0 = min(2 * x, srcWidth - 1) * components;
+			int x1 = min(2 * x + 1, srcWidth - 1) * components;
+			const unsigned char* texels[4] = { rows[0] + x0, rows[0] + x1, rows[1] + x0, rows[1] + x1 };
+
+			int c = 0;
+			if (normalMap)
+			{
+				float n[3] = { 0.0f, 0.0f, 0.0f };
+				for (const unsigned char* t : texels)
+					for (int i = 0; i < 3; i++)
+						n[i] += t[i] / 127.5f - 1.0f;
+				float length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length > 0.0f)
+				{
+					for (int i = 0; i < 3; i++)
+						out[i] = (unsigned char)min(max((n[i] / length * 0.5f + 0.5f) * 255.0f + 0.5f, 0.0f), 255.0f);
+				}
+				else
+				{
+					out[0] = 128; out[1] = 128; out[2] = 255;
+				}
+				c = 3;
+			}
+			for (; c < components; c++)
+			{
+				if (c < colorChannels)
+				{
+					float sum = toLinear[texels[0][c]] + toLinear[texels[1][c]] + toLinear[texels[2][c]] + toLinear[texels[3][c]];
+					out[c] = LinearToSrgb(sum * 0.25f);
+				}
+				else
+				{
+					out[c] = (unsigned char)((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+				}
+			}
+		}
+	}
+}
+
+TextureContainer::TextureContainer()
+{
+	memset(&header, 0, sizeof(Header));
+	components = 0;
+	format = BLOCK_FORMAT_NONE;
+	dataSize = 0;
+}
+
+TextureContainer::~TextureContainer()
+{
+	Release();
+}
+
+void TextureContainer::SetLevels(const unsigned char* data, int width, int height)
+{
+	levels.clear();
+	dataSize = 0;
+	while (true)
+	{
+		Level level;
+		level.pixels = data + dataSize;
+		level.width = width;
+		level.height = height;
+		level.size = LevelSize(width, height, components, format);
+		levels.push_back(level);
+		dataSize += level.size;
+		if (width == 1 && height == 1)
+			break;
+		width = max(1, width / 2);
+		height = max(1, height / 2);
+	}
+}
+
+bool TextureContainer::Load(const char* imagePath, uint32_t flags)
+{
+	Release();
+
+	uint64_t imageSize;
+	int64_t imageMtime;
+	if (!MappedFile::Stat(imagePath, &imageSize, &imageMtime))
+		return false;
+
+	std::string path = ContainerPath(imagePath);
+	if (!file.Open(path.c_str()))
+		return false;
+	if (file.Size() < sizeof(Header))
+	{
+		Release();
+		return false;
+	}
+
+	//validate: magic, version, key and sizes
+	memcpy(&header, file.Data(), sizeof(Header));
+	if (memcmp(header.magic, TEXTURE_CONTAINER_MAGIC, 4) != 0 || header.version != VERSION || header.flags != flags
+		|| header.imageSize != imageSize || header.imageMtime != imageMtime || header.width == 0 || header.height == 0
+		|| header.components < 1 || header.components > 4 || header.format > BLOCK_FORMAT_BC5
+		|| header.dataSize != ChainSize(header.width, header.height, header.components, (BlockFormat)header.format)
+		|| sizeof(Header) + header.dataSize != file.Size())
+	{
+		Release();
+		return false;
+	}
+
+	components = (int)header.components;
+	format = (BlockFormat)header.format;
+	SetLevels((const unsigned char*)file.Data() + sizeof(Header), (int)header.width, (int)header.height);
+	return true;
+}
+
+bool TextureContainer::Bake(const char* imagePath, uint32_t flags, ThreadPool* pool)
+{
+	Release();
+
+	memcpy(header.magic, TEXTURE_CONTAINER_MAGIC, 4);
+	header.version = VERSION;
+	header.flags = flags;
+	if (!MappedFile::Stat(imagePath, &header.imageSize, &header.imageMtime))
+		return false;
+
+	//normal maps need x, y and z for the renormalized mips, whatever the file stores
+	bool normalMap = (flags & NORMAL_MAP) != 0;
+	int width, height;
+	unsigned char* pixels = stbi_load(imagePath, &width, &height, &components, normalMap ? 3 : 0);
+	if (pixels == NULL)
+		return false;
+	if (normalMap)
+		components = 3;
+	if (components < 1 || components > 4)
+	{
+		stbi_image_free(pixels);
+		return false;
+	}
+
+	header.width = width;
+	header.height = height;
+	baked.resize(ChainSize(width, height, components, BLOCK_FORMAT_NONE));
+	memcpy(baked.data(), pixels, (size_t)width * height * components);
+	stbi_image_free(pixels);
+
+	SetLevels(baked.data(), width, height);
+	for (size_t i = 1; i < levels.size(); i++)
+	{
+		const Level& src = levels[i - 1];
+		const Level& dst = levels[i];
+		unsigned char* out = baked.data() + (dst.pixels - baked.data());
+		auto rows = [&](size_t begin, size_t end)
+		{
+			Downsample(src.pixels, src.width, src.height, out, dst.width, components, flags, begin, end);
+		};
+
+		//about 64k texels per chunk; the small levels are not worth splitting
+		size_t grain = max((size_t)1, (size_t)65536 / dst.width);
+		if (pool != NULL && (size_t)dst.height > grain)
+			pool->ParallelFor(dst.height, grain, rows);
+		else
+			rows(0, dst.height);
+	}
+
+	if (normalMap)
+	{
+		//only x and y are kept, z = sqrt(1 - x * x - y * y) is rebuilt in the shader. Compacted in place, front to back
+		size_t texels = dataSize / 3;
+		for (size_t t = 0; t < texels; t++)
+		{
+			baked[2 * t] = baked[3 * t];
+			baked[2 * t + 1] = baked[3 * t + 1];
+		}
+		baked.resize(texels * 2);
+		components = 2;
+		SetLevels(baked.data(), width, height);
+	}
+
+	if (flags & BLOCK_COMPRESSED)
+	{
+		BlockFormat blockFormat = normalMap ? BLOCK_FORMAT_BC5 : (HasTranslucentTexels() ? BLOCK_FORMAT_BC3 : BLOCK_FORMAT_BC1);
+		std::vector<unsigned char> blocks(ChainSize(width, height, components, blockFormat));
+		unsigned char* out = blocks.data();
+		for (const Level& level : levels)
+		{
+			CompressBlocks(blockFormat, level.pixels, level.width, level.height, components, out, pool);
+			out += CompressedSize(blockFormat, level.width, level.height);
+		}
+		baked.swap(blocks);
+		format = blockFormat;
+		SetLevels(baked.data(), width, height);
+	}
+
+	header.components = components;
+	header.format = format;
+	header.dataSize = dataSize;
+	return true;
+}
+
+//any alpha below 255 in the base level (of an uncompressed grey + alpha or rgba chain)
+bool TextureContainer::HasTranslucentTexels() const
+{
+	if (components != 2 && components != 4)
+		return false;
+	const Level& base = levels[0];
+	for (size_t i = components - 1; i < base.size; i += components)
+	{
+		if (base.pixels[i] != 255)
+			return true;
+	}
+	return false;
+}
+
+bool TextureContainer::Store(const char* imagePath) const
+{
+	if (!IsLoaded())
+		return false;
+
+	//write to a temporary file and rename it, so a crash never leaves a truncated container behind
+	std::string path = ContainerPath(imagePath);
+	std::string tmpPath = path + ".tmp";
+	FILE* f = fopen(tmpPath.c_str(), "wb");
+	if (f == NULL)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(Header), 1, f) == 1;
+	if (ok)
+		ok = fwrite(Data(), 1, dataSize, f) == dataSize;
+	ok = (fclose(f) == 0) && ok;
+
+	if (!ok)
+	{
+		remove(tmpPath.c_str());
+		return false;
+	}
+
+	remove(path.c_str());
+	return rename(tmpPath.c_str(), path.c_str()) == 0;
+}
+
+void TextureContainer::Release()
+{
+	file.Close();
+	baked.clear();
+	baked.shrink_to_fit();
+	levels.clear();
+	components = 0;
+	format = BLOCK_FORMAT_NONE;
+	dataSize = 0;
+}
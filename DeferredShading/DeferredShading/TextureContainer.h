@@ -0,0 +1,87 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#include "BlockCompression.h"
+#include "MappedFile.h"
+#include "ThreadPool.h"
+
+//precomputed-mip texture container: the decoded base level of an image and its whole mip chain, down to 1x1, stored
+//next to the image (<image>.dstex) and only valid for the image size and modification time it was baked from.
+//A valid container is memory-mapped and its levels are uploaded as they are, with no decode and no glGenerateMipmap.
+//Mips are 2x2 box filtered in linear space: color channels are decoded from sRGB before averaging and encoded back,
+//normal maps are averaged as vectors and renormalized.
+//Normal maps keep only x and y (z is rebuilt in the shader). With BLOCK_COMPRESSED every level is then encoded, color as
+//BC1 (BC3 when the image has translucent texels) and normal maps as BC5.
+class TextureContainer
+{
+public:
+	//bump whenever the layout of the levels (or of the header) changes
+	static const uint32_t VERSION = 2;
+
+	//bits for the flags parameter: anything that changes the baked levels for the same image
+	enum Flags { NORMAL_MAP = 1, BLOCK_COMPRESSED = 2 };
+
+	struct Level
+	{
+		const unsigned char* pixels;
+		size_t size;
+		int width, height;
+	};
+
+	TextureContainer();
+	~TextureContainer();
+
+	TextureContainer(const TextureContainer&) = delete;
+	TextureContainer& operator=(const TextureContainer&) = delete;
+
+	//maps and validates the container of imagePath. Returns false (and keeps nothing) if it is missing or stale
+	bool Load(const char* imagePath, uint32_t flags);
+
+	//decodes imagePath and builds its mip chain in memory, block compressing it with BLOCK_COMPRESSED. The rows of each
+	//level are split over pool when there is one. Returns false if the image can't be decoded
+	bool Bake(const char* imagePath, uint32_t flags, ThreadPool* pool);
+
+	//writes the levels (loaded or baked) as the container of imagePath. Returns false on io error
+	bool Store(const char* imagePath) const;
+
+	void Release();
+
+	bool IsLoaded() const { return !levels.empty(); }
+	int Components() const { return components; }
+	BlockFormat Format() const { return format; }
+	int LevelCount() const { return (int)levels.size(); }
+	const Level& GetLevel(int i) const { return levels[i]; }
+	//the levels are contiguous, base level first
+	const unsigned char* Data() const { return levels.empty() ? NULL : levels[0].pixels; }
+	size_t DataSize() const { return dataSize; }
+
+private:
+	struct Header
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t flags;
+		uint32_t width;
+		uint32_t height;
+		uint32_t components;
+		uint32_t format;   //BlockFormat
+		uint32_t reserved; //zero, keeps the 64 bit fields aligned
+		uint64_t imageSize;
+		int64_t imageMtime;
+		uint64_t dataSize;
+	};
+
+	void SetLevels(const unsigned char* data, int width, int height);
+	bool HasTranslucentTexels() const;
+
+	MappedFile file;
+	std::vector<unsigned char> baked;
+	Header header;
+
+	int components;
+	BlockFormat format;
+	std::vector<Level> levels;
+	size_t dataSize;
+};
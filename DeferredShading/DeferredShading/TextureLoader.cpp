@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "TextureLoader.h"
+
+using namespace std;
+
+//EXT_texture_compression_s3tc is not in the generated loader (RGTC, for BC5, is core)
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+TextureLoader::TextureLoader()
+{
+	bytesPerFrame = 0;
+	pending = 0;
+	stopping = false;
+}
+
+TextureLoader::~TextureLoader()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+
+	//the gl objects die with the context, the containers with the deques
+}
+
+void TextureLoader::Initialize(unsigned int nThreads, size_t budget)
+{
+	if (nThreads == 0)
+		nThreads = max(2u, std::thread::hardware_concurrency()) - 1;
+	bytesPerFrame = max(budget, (size_t)1);
+
+	for (unsigned int i = 0; i < nThreads; i++)
+		workers.emplace_back(&TextureLoader::WorkerLoop, this);
+}
+
+unsigned int TextureLoader::Load(const char* path, const unsigned char placeholder[4], uint32_t flags)
+{
+	unsigned int texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		Request request = { texture, path, flags };
+		requests.push_back(request);
+	}
+	pending++;
+	wake.notify_one();
+	return texture;
+}
+
+void TextureLoader::WorkerLoop()
+{
+	while (true)
+	{
+		Request request;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [&] { return stopping || !requests.empty(); });
+			if (stopping)
+				return;
+			request = requests.front();
+			requests.pop_front();
+		}
+
+		Decoded image;
+		image.texture = request.texture;
+		image.path = request.path;
+		image.image = std::make_shared<TextureContainer>();
+		image.fromContainer = image.image->Load(request.path.c_str(), request.flags);
+		image.pbo = 0;
+		image.copied = 0;
+		//the other workers keep the cores busy, the mips are baked serially
+		if (!image.fromContainer && image.image->Bake(request.path.c_str(), request.flags, NULL)
+			&& !image.image->Store(request.path.c_str()))
+		{
+			cout << "Failed to write texture container for " << request.path << endl;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			decoded.push_back(image);
+		}
+		decodedReady.notify_all();
+	}
+}
+
+//copies up to budget bytes of image into its PBO; once complete, respecifies the texture from it.
+//Returns true when the image is done (uploaded or failed)
+bool TextureLoader::Upload(Decoded& image, size_t budget, size_t* used)
+{
+	*used = 0;
+	if (!image.image->IsLoaded())
+	{
+		std::cout << "Texture failed to load at path: " << image.path << std::endl;
+		failed.push_back(image.texture);
+		image.image.reset();
+		return true;
+	}
+
+	const TextureContainer& container = *image.image;
+	size_t size = container.DataSize();
+	if (image.pbo == 0)
+	{
+		glGenBuffers(1, &image.pbo);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image.pbo);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+	}
+	else
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, image.pbo);
+	}
+
+	size_t chunk = min(budget, size - image.copied);
+	if (chunk > 0)
+	{
+		//nothing reads the PBO before it is complete, so there is nothing to synchronize with
+		void* destination = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, image.copied, chunk,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if (destination == NULL)
+		{
+			//the texture keeps its placeholder, as when the file fails to load
+			std::cout << "Texture failed to upload at path: " << image.path << std::endl;
+			failed.push_back(image.texture);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+			glDeleteBuffers(1, &image.pbo);
+			image.pbo = 0;
+			image.image.reset();
+			return true;
+		}
+		memcpy(destination, container.Data() + image.copied, chunk);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		image.copied += chunk;
+		*used = chunk;
+	}
+
+	bool complete = image.copied == size;
+	if (complete)
+	{
+		GLenum formats[4] = { GL_RED, GL_RG, GL_RGB, GL_RGBA };
+		GLenum format = formats[container.Components() - 1];
+		GLenum blockFormats[4] = { GL_NONE, GL_COMPRESSED_RGB_S3TC_DXT1_EXT, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT, GL_COMPRESSED_RG_RGTC2 };
+
+		//rows of RGB (and RED) images, and of the small mips, are not 4 byte aligned in general
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		glBindTexture(GL_TEXTURE_2D, image.texture);
+		for (int i = 0; i < container.LevelCount(); i++)
+		{
+			const TextureContainer::Level& level = container.GetLevel(i);
+			void* offset = (void*)(level.pixels - container.Data());
+			if (container.Format() == BLOCK_FORMAT_NONE)
+				glTexImage2D(GL_TEXTURE_2D, i, format, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, offset);
+			else
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, blockFormats[container.Format()], level.width, level.height, 0, (GLsizei)level.size, offset);
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, container.LevelCount() - 1);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+		//the driver keeps the storage alive until the copy has been done
+		glDeleteBuffers(1, &image.pbo);
+		image.pbo = 0;
+		cout << image.path << ": " << container.GetLevel(0).width << "," << container.GetLevel(0).height << ", "
+			<< container.LevelCount() << " levels" << (container.Format() != BLOCK_FORMAT_NONE ? ", block compressed" : "") << (image.fromContainer ? " from the texture container" : " baked") << endl;
+
+		image.image.reset();
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	return complete;
+}
+
+std::vector<unsigned int> TextureLoader::TakeFailed()
+{
+	std::vector<unsigned int> textures;
+	textures.swap(failed);
+	return textures;
+}
+
+bool TextureLoader::SupportsS3TC()
+{
+	GLint count = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i = 0; i < count; i++)
+	{
+		const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+		if (extension != NULL && strcmp(extension, "GL_EXT_texture_compression_s3tc") == 0)
+			return true;
+	}
+	return false;
+}
+
+void TextureLoader::Update()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		while (!decoded.empty())
+		{
+			uploads.push_back(decoded.front());
+			decoded.pop_front();
+		}
+	}
+
+	size_t budget = bytesPerFrame;
+	while (!uploads.empty() && budget > 0)
+	{
+		size_t used;
+		if (!Upload(uploads.front(), budget, &used))
+			break;
+		budget -= min(used, budget);
+		uploads.pop_front();
+		pending--;
+	}
+}
+
+void TextureLoader::Finish()
+{
+	while (pending > 0)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			decodedReady.wait(lock, [&] { return !decoded.empty() || uploads.size() == pending; });
+			while (!decoded.empty())
+			{
+				uploads.push_back(decoded.front());
+				decoded.pop_front();
+			}
+		}
+
+		while (!uploads.empty())
+		{
+			size_t used;
+			while (!Upload(uploads.front(), (size_t)-1, &used))
+			{
+			}
+			uploads.pop_front();
+			pending--;
+		}
+	}
+}
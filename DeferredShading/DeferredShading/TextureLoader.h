@@ -0,0 +1,83 @@
+#pragma once
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "TextureContainer.h"
+
+//asynchronous texture loading. Load hands back a texture name right away, holding a 1x1 placeholder color. A worker
+//thread maps the image's TextureContainer or, when it is missing or stale, decodes the image, bakes its mips and
+//stores the container for the next start. Update, on the gl thread, copies the levels into a pixel buffer object, at
+//most bytesPerFrame per frame. Once every level is in the PBO the texture is respecified from it, so a texture is never
+//seen half uploaded.
+class TextureLoader
+{
+public:
+	TextureLoader();
+	~TextureLoader();
+
+	TextureLoader(const TextureLoader&) = delete;
+	TextureLoader& operator=(const TextureLoader&) = delete;
+
+	//starts the decoding threads. nThreads == 0: hardware_concurrency() - 1, at least 1
+	void Initialize(unsigned int nThreads = 0, size_t bytesPerFrame = 4 << 20);
+
+	//needs a current context. placeholder is the RGBA color shown until the file arrives, and kept if it fails to load.
+	//flags are TextureContainer::Flags
+	unsigned int Load(const char* path, const unsigned char placeholder[4], uint32_t flags = 0);
+
+	//gl thread, once per frame: uploads decoded images within the byte budget
+	void Update();
+
+	//gl thread: waits for every request and uploads them all, ignoring the budget
+	void Finish();
+
+	//needs a current context: BC1/BC3 (TextureContainer::BLOCK_COMPRESSED color textures) can be uploaded. BC5 always can
+	static bool SupportsS3TC();
+
+	//requests not uploaded yet (decoding, decoded or partially copied)
+	size_t Pending() const { return pending; }
+
+	//gl thread: the textures whose file failed to load, or whose upload failed, since the last call. They keep their placeholder
+	std::vector<unsigned int> TakeFailed();
+
+private:
+	struct Request
+	{
+		unsigned int texture;
+		std::string path;
+		uint32_t flags;
+	};
+
+	struct Decoded
+	{
+		unsigned int texture;
+		std::string path;
+		std::shared_ptr<TextureContainer> image; //not loaded if decoding failed
+		bool fromContainer;
+		unsigned int pbo;
+		size_t copied;
+	};
+
+	size_t bytesPerFrame;
+	size_t pending;
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable decodedReady;
+	std::deque<Request> requests;
+	std::deque<Decoded> decoded; //filled by the workers
+	bool stopping;
+
+	std::deque<Decoded> uploads; //gl thread only, in arrival order
+	std::vector<unsigned int> failed; //gl thread only
+
+	void WorkerLoop();
+	bool Upload(Decoded& image, size_t budget, size_t* used);
+};
@@ -0,0 +1,130 @@
+#include <algorithm>
+
+#include "ThreadPool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned int nThreads)
+{
+	if (nThreads == 0)
+		nThreads = max(1u, std::thread::hardware_concurrency());
+
+	job = NULL;
+	remaining = 0;
+	busy = false;
+	generation = 0;
+	stopping = false;
+
+	for (unsigned int i = 0; i < nThreads; i++)
+		queues.emplace_back(new Queue());
+	for (unsigned int i = 1; i < nThreads; i++)
+		workers.emplace_back(&ThreadPool::WorkerLoop, this, (size_t)i);
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers)
+		worker.join();
+}
+
+ThreadPool& ThreadPool::Shared()
+{
+	static ThreadPool pool;
+	return pool;
+}
+
+//runs one task: from the back of our own queue, or stolen from the front of another one
+bool ThreadPool::RunOne(size_t self)
+{
+	Task task;
+	bool found = false;
+	for (size_t i = 0; i < queues.size() && !found; i++)
+	{
+		Queue& queue = *queues[(self + i) % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (queue.tasks.empty())
+			continue;
+		if (i == 0)
+		{
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+		}
+		else
+		{
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+		}
+		found = true;
+	}
+	if (!found)
+		return false;
+
+	(*job)(task.begin, task.end);
+	if (remaining.fetch_sub(1) == 1)
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		done.notify_all();
+	}
+	return true;
+}
+
+void ThreadPool::WorkerLoop(size_t self)
+{
+	unsigned long long seen = 0;
+	while (true)
+	{
+		{
+			std::unique_lock<std::mutex> lock(stateMutex);
+			wake.wait(lock, [&] { return stopping || generation != seen; });
+			if (stopping)
+				return;
+			seen = generation;
+		}
+		while (RunOne(self))
+		{
+		}
+	}
+}
+
+void ThreadPool::ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn)
+{
+	grain = max(grain, (size_t)1);
+	size_t nChunks = (count + grain - 1) / grain;
+	if (nChunks == 0)
+		return;
+	if (nChunks == 1 || workers.empty() || busy.exchange(true))
+	{
+		for (size_t begin = 0; begin < count; begin += grain)
+			fn(begin, min(count, begin + grain));
+		return;
+	}
+
+	job = &fn;
+	remaining = nChunks;
+	for (size_t k = 0; k < nChunks; k++)
+	{
+		Queue& queue = *queues[k % queues.size()];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.tasks.push_back({ k * grain, min(count, (k + 1) * grain) });
+	}
+	{
+		std::lock_guard<std::mutex> lock(stateMutex);
+		generation++;
+	}
+	wake.notify_all();
+
+	while (RunOne(0))
+	{
+	}
+
+	{
+		std::unique_lock<std::mutex> lock(stateMutex);
+		done.wait(lock, [&] { return remaining.load() == 0; });
+	}
+	busy = false;
+}
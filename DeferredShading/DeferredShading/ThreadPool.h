@@ -0,0 +1,63 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+//persistent work stealing thread pool for per-frame jobs.
+//ParallelFor splits a range into chunks dealt round robin to one deque per thread; each thread pops from the back of
+//its own deque and, once it runs dry, steals from the front of the others. The calling thread works too.
+//One job runs at a time: a ParallelFor issued while another is running (from inside a chunk, or from another thread)
+//runs its chunks inline on the calling thread.
+class ThreadPool
+{
+public:
+	//nThreads counts the calling thread; 0 uses std::thread::hardware_concurrency()
+	explicit ThreadPool(unsigned int nThreads = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	unsigned int ThreadCount() const { return (unsigned int)queues.size(); }
+
+	//the process wide pool, created on first use, for the loops outside the frame (model loading, ::ParallelFor)
+	static ThreadPool& Shared();
+
+	//runs fn(begin, end) over [0, count) in chunks of at most grain items, and returns when every chunk is done.
+	//chunk k covers [k * grain, min(count, (k + 1) * grain)), so fn may use begin / grain to index per chunk output
+	void ParallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)>& fn);
+
+private:
+	struct Task
+	{
+		size_t begin, end;
+	};
+
+	struct Queue
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks;
+	};
+
+	std::vector<std::unique_ptr<Queue>> queues; //queues[0] belongs to the calling thread
+	std::vector<std::thread> workers;
+
+	const std::function<void(size_t, size_t)>* job;
+	std::atomic<size_t> remaining;
+	std::atomic<bool> busy;
+
+	std::mutex stateMutex;
+	std::condition_variable wake;
+	std::condition_variable done;
+	unsigned long long generation;
+	bool stopping;
+
+	bool RunOne(size_t self);
+	void WorkerLoop(size_t self);
+};
@@ -4,7 +4,15 @@
 
 //Fragment Shader
 
+//permutaes: BuildShader injeta SPECIALIZED, DEBUG_VIEW e COMPACT_GBUFFER, e s a visualizao escolhida 
+//compilada. Sem elas (shader genrico) vm de uniforms
+#ifdef SPECIALIZED
+const int selectTexture = DEBUG_VIEW;
+const bool compactGBuffer = COMPACT_GBUFFER;
+#else
 uniform int selectTexture;
+uniform bool compactGBuffer;
+#endif
 
 //as texturas, passadas pelo geometry pass:
 in vec2 fgtexCoord;
@@ -14,6 +22,34 @@ uniform sampler2D gColorSpec;
 uniform sampler2D gTangent;
 uniform sampler2D gBitangent;
 
+//G-buffer compacto: posio reconstruda da profundidade, normal em octaedro.
+//4 mostra a profundidade e 5 a normal, j que tangente e bitangente no so guardadas
+uniform sampler2D gDepth;
+
+//dados da cmera (std140): um uniform buffer compartilhado por todos os programas, s reenviado quando muda
+layout (std140) uniform Camera
+{
+	mat4 mvp;           //model-view-projection
+	mat4 mv;            //model-view
+	mat4 v;             //view
+	mat4 m;             //model
+	mat4 ITmv;          //inversa transposta da model-view
+	mat4 vp;            //view-projection
+	mat4 invProjection;
+	mat4 invView;
+	vec3 eye;           //em coordenadas do mundo
+};
+
+vec3 octDecode(vec2 e)
+{
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0)
+	{
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0 ? 1.0 : -1.0, n.y >= 0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
 out vec4 pixelColor;
 
 void main()
@@ -24,6 +60,16 @@ void main()
 	vec4 fgColor = texture(gColorSpec, fgtexCoord); // ...
 	vec3 tangent = vec3(texture(gTangent, fgtexCoord)); // ...
 	vec3 bitangent = vec3(texture(gBitangent, fgtexCoord)); // ...
+
+	if (compactGBuffer)
+	{
+		float depth = texture(gDepth, fgtexCoord).r;
+		vec4 viewPosition = invProjection * vec4(fgtexCoord * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+		position = (invView * vec4(viewPosition.xyz / viewPosition.w, 1.0)).xyz;
+		bumpNormal = octDecode(texture(gNormal, fgtexCoord).rg * 2.0 - 1.0);
+		tangent = vec3(depth);
+		bitangent = bumpNormal;
+	}
 	
 	if(selectTexture == 1)
 	{
@@ -0,0 +1,35 @@
+#version 410 core
+
+//Vertex Shader dos light volumes: uma esfera unitária por luz, instanciada, com o fragment shader do L pass
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in uint lightIndex; //um por instância
+
+//dados da câmera (std140): um uniform buffer compartilhado por todos os programas, só reenviado quando muda
+layout (std140) uniform Camera
+{
+	mat4 mvp;           //model-view-projection
+	mat4 mv;            //model-view
+	mat4 v;             //view
+	mat4 m;             //model
+	mat4 ITmv;          //inversa transposta da model-view
+	mat4 vp;            //view-projection
+	mat4 invProjection;
+	mat4 invView;
+	vec3 eye;           //em coordenadas do mundo
+};
+
+//luzes: 2 texels por luz, posição + raio e cor, a partir do texel lightDataBase (região deste quadro no anel)
+uniform samplerBuffer lightData;
+uniform int lightDataBase;
+
+out vec2 fgtexCoord; //não usado, o fragment shader usa gl_FragCoord
+flat out int volumeLight;
+
+void main()
+{
+	vec4 positionRadius = texelFetch(lightData, lightDataBase + 2 * int(lightIndex));
+	volumeLight = int(lightIndex);
+	fgtexCoord = vec2(0, 0);
+	gl_Position = vp * vec4(positionRadius.xyz + aPos * positionRadius.w, 1.0);
+}
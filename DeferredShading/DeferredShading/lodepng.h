@@ -275,6 +275,10 @@ struct LodePNGDecompressSettings {
 		const LodePNGDecompressSettings*);
 
 	const void* custom_context; /*optional custom settings for custom functions*/
+
+	/*Modified: decode Huffman blocks through lookup tables, reading 64 bits at a time, or with the original bit at a
+	time decoder (0). Both give identical output and errors. Default: 1*/
+	unsigned fast_inflate;
 };
 
 extern const LodePNGDecompressSettings lodepng_default_decompress_settings;
@@ -308,10 +312,18 @@ struct LodePNGCompressSettings /*deflate = compress*/ {
 		const LodePNGCompressSettings*);
 
 	const void* custom_context; /*optional custom settings for custom functions*/
+
+	/*deflate with up to this many threads (C++ only, ignored with custom_deflate). Data over 128k is split in
+	up to threads chunks of at least 128k (LODEPNG_PARALLEL_MIN_CHUNK), each deflated on its own thread with the end of
+	the previous one as dictionary, and concatenated into one ordinary zlib stream: a little larger, decodable by any
+	inflater. Default: 1*/
+	unsigned threads;
 };
 
 extern const LodePNGCompressSettings lodepng_default_compress_settings;
 void lodepng_compress_settings_init(LodePNGCompressSettings* settings);
+/*the default settings with a small window and no lazy matching: several times faster, some percent larger*/
+void lodepng_compress_settings_init_fast(LodePNGCompressSettings* settings);
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
 #ifdef LODEPNG_COMPILE_PNG
@@ -629,6 +641,10 @@ typedef struct LodePNGDecoderSettings {
 
 	unsigned color_convert; /*whether to convert the PNG to the color type you want. Default: yes*/
 
+	/*Modified: unfilter with SSE2 where the compiler targets it (x64, or x86 with /arch:SSE2), or with the original
+	scalar code. Both give identical bytes. Default: 1*/
+	unsigned simd_filters;
+
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
 	unsigned read_text_chunks; /*if false but remember_unknown_chunks is true, they're stored in the unknown chunks*/
 							   /*store all bytes from unknown chunks in the LodePNGInfo (off by default, useful for a png editor)*/
@@ -713,6 +729,9 @@ typedef struct LodePNGEncoderSettings {
 	/*force creating a PLTE chunk if colortype is 2 or 6 (= a suggested palette).
 	If colortype is 3, PLTE is _always_ created.*/
 	unsigned force_palette;
+	/*Modified: filter, and pick filters by minimum sum, with SSE2 where the compiler targets it (x64, or x86 with
+	/arch:SSE2), or with the original scalar code. Both give identical bytes. Default: 1*/
+	unsigned simd_filters;
 #ifdef LODEPNG_COMPILE_ANCILLARY_CHUNKS
 	/*add LodePNG identifier and version as a text chunk, for debugging*/
 	unsigned add_id;
@@ -883,8 +902,31 @@ unsigned lodepng_chunk_create(unsigned char** out, size_t* outlength, unsigned l
 
 /*Calculate CRC32 of buffer*/
 unsigned lodepng_crc32(const unsigned char* buf, size_t len);
+/*Modified: the same at the given LODEPNG_CHECKSUM_LEVEL instead of the compiled one. Not with LODEPNG_NO_COMPILE_CRC*/
+unsigned lodepng_crc32_level(const unsigned char* buf, size_t len, unsigned level);
+
+#ifdef LODEPNG_COMPILE_ENCODER
+/*Filters one scanline of length bytes with filterType 0-4, bytewidth bytes per pixel (at least 1). prevline is NULL for
+the first scanline. simd as in LodePNGEncoderSettings*/
+void lodepng_filter_scanline(unsigned char* out, const unsigned char* scanline, const unsigned char* prevline,
+	size_t length, size_t bytewidth, unsigned char filterType, unsigned simd);
+#endif /*LODEPNG_COMPILE_ENCODER*/
+#ifdef LODEPNG_COMPILE_DECODER
+/*Reverses lodepng_filter_scanline; recon may be the same buffer as scanline. Returns error 36 for an invalid filterType*/
+unsigned lodepng_unfilter_scanline(unsigned char* recon, const unsigned char* scanline, const unsigned char* precon,
+	size_t length, size_t bytewidth, unsigned char filterType, unsigned simd);
+#endif /*LODEPNG_COMPILE_DECODER*/
 #endif /*LODEPNG_COMPILE_PNG*/
 
+/*
+Modified: how lodepng_crc32 and the zlib Adler32 are computed, with identical results. 0: the original byte at a time
+loops. 1: slicing-by-8 CRC32 and, where the compiler targets SSE2, vectorized Adler32. 2: also CRC32 folded with
+PCLMULQDQ when cpuid reports it. Define before building lodepng to choose another. Default: 2
+*/
+#ifndef LODEPNG_CHECKSUM_LEVEL
+#define LODEPNG_CHECKSUM_LEVEL 2
+#endif
+
 
 #ifdef LODEPNG_COMPILE_ZLIB
 /*
@@ -893,6 +935,11 @@ buffer. It cannot be used to create gzip files however, and it only supports the
 part of zlib that is required for PNG, it does not support dictionaries.
 */
 
+/*Modified: the Adler32 of a buffer, as in the zlib trailer*/
+unsigned lodepng_adler32(const unsigned char* data, size_t length);
+/*Modified: the same at the given LODEPNG_CHECKSUM_LEVEL instead of the compiled one*/
+unsigned lodepng_adler32_level(const unsigned char* data, size_t length, unsigned level);
+
 #ifdef LODEPNG_COMPILE_DECODER
 /*Inflate a buffer. Inflate is the decompression step of deflate. Out buffer must be freed after use.*/
 unsigned lodepng_inflate(unsigned char** out, size_t* outsize,
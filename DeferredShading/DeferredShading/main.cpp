@@ -1,12 +1,222 @@
+#include <cctype>
+#include <chrono>
 #include <iostream>
+#include <cstring>
+#include <cstdlib>
 #include "GLWindowManager.h"
+#include "PngBenchmark.h"
+#include "QoiCodec.h"
 
 using namespace std;
 
 
-int main()
+//offline texture baker: writes the TextureContainer (base level + gamma correct mips, block compressed unless
+//--uncompressed-textures) of every --bake-texture and --bake-normal-map image, so the first launch does not pay for it.
+//Returns false if there was nothing to bake
+static bool BakeTextures(int argc, char** argv)
 {
-	GLWindowManager wm = GLWindowManager();
+	uint32_t compression = TextureContainer::BLOCK_COMPRESSED;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--uncompressed-textures") == 0)
+			compression = 0;
+	}
+
+	ThreadPool pool;
+	bool any = false;
+	for (int i = 1; i + 1 < argc; i++)
+	{
+		uint32_t flags;
+		if (strcmp(argv[i], "--bake-texture") == 0)
+			flags = compression;
+		else if (strcmp(argv[i], "--bake-normal-map") == 0)
+			flags = TextureContainer::NORMAL_MAP | compression;
+		else
+			continue;
+		const char* path = argv[++i];
+		any = true;
+
+		auto start = std::chrono::high_resolution_clock::now();
+		TextureContainer container;
+		if (!container.Bake(path, flags, &pool))
+		{
+			cout << "Texture failed to load at path: " << path << endl;
+			continue;
+		}
+		if (!container.Store(path))
+		{
+			cout << "Failed to write texture container for " << path << endl;
+			continue;
+		}
+		std::chrono::duration<double, std::milli> bakeTime = std::chrono::high_resolution_clock::now() - start;
+		cout << path << ": " << container.GetLevel(0).width << "," << container.GetLevel(0).height << ", "
+			<< container.LevelCount() << " levels baked in " << bakeTime.count() << " ms" << endl;
+	}
+	return any;
+}
+
+int main(int argc, char** argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--dedup-benchmark") == 0)
+		{
+			int triangles = (i + 1 < argc) ? atoi(argv[i + 1]) : 4000000;
+			RunDedupBenchmark(triangles > 0 ? triangles : 4000000);
+			return 0;
+		}
+		if (strcmp(argv[i], "--tangent-benchmark") == 0 && i + 1 < argc)
+		{
+			RunTangentBenchmark(argv[i + 1]);
+			return 0;
+		}
+		if (strcmp(argv[i], "--tangent-golden") == 0)
+		{
+			return RunTangentGoldenTest(i + 1 < argc ? argv[i + 1] : "golfball/golfball.obj") ? 0 : 1;
+		}
+		if (strcmp(argv[i], "--light-binning-benchmark") == 0)
+		{
+			RunLightBinningBenchmark();
+			return 0;
+		}
+		if (strcmp(argv[i], "--compression-benchmark") == 0 && i + 1 < argc)
+		{
+			RunCompressionBenchmark(argv[i + 1]);
+			return 0;
+		}
+		if (strcmp(argv[i], "--png-benchmark") == 0 && i + 1 < argc)
+		{
+			RunPngEncodingBenchmark(argv[i + 1]);
+			return 0;
+		}
+		if (strcmp(argv[i], "--png-filter-benchmark") == 0 && i + 1 < argc)
+		{
+			RunPngFilterBenchmark(argv[i + 1]);
+			return 0;
+		}
+		if (strcmp(argv[i], "--checksum-benchmark") == 0)
+		{
+			int megabytes = (i + 1 < argc) ? atoi(argv[i + 1]) : 100;
+			RunChecksumBenchmark(megabytes > 0 ? megabytes : 100);
+			return 0;
+		}
+		if (strcmp(argv[i], "--inflate-benchmark") == 0 && i + 1 < argc)
+		{
+			RunInflateBenchmark(std::vector<std::string>(argv + i + 1, argv + argc));
+			return 0;
+		}
+		if (strcmp(argv[i], "--qoi-benchmark") == 0 && i + 1 < argc)
+		{
+			RunQoiBenchmark(argv[i + 1]);
+			return 0;
+		}
+		if (strcmp(argv[i], "--qoi-to-png") == 0 && i + 1 < argc)
+		{
+			//every file next to itself, x.qoi to x.png
+			int failed = 0;
+			for (int j = i + 1; j < argc; j++)
+			{
+				std::string path = argv[j];
+				std::string png = (path.size() > 4 && path.compare(path.size() - 4, 4, ".qoi") == 0 ? path.substr(0, path.size() - 4) : path) + ".png";
+				if (!ConvertQoiToPng(path, png))
+					failed++;
+			}
+			return failed > 0 ? 1 : 0;
+		}
+	}
+	if (BakeTextures(argc, argv))
+	{
+		return 0;
+	}
+
+	GLWindowManager wm;
+
+	//usage: DeferredShading [--headless [frames, default 300]] [--serial-obj] [--no-mesh-optimization] [--vertex-layout float|packed|packed16] [--gbuffer full|compact] [--tiled-lights <n>] [--clustered-lights <n>] [--light-volumes <n>] [--animate-lights] [--no-program-cache] [--generic-shaders] [--uncompressed-textures] [--capture-every <n>] [--capture-format png|qoi]
+	//       DeferredShading --dedup-benchmark [triangles, default 4000000]
+	//       DeferredShading --tangent-benchmark <obj>
+	//       DeferredShading --tangent-golden [obj, default golfball/golfball.obj]
+	//       DeferredShading --light-binning-benchmark
+	//       DeferredShading --compression-benchmark <image>
+	//       DeferredShading --png-benchmark <png>
+	//       DeferredShading --png-filter-benchmark <png>
+	//       DeferredShading --checksum-benchmark [MB, default 100]
+	//       DeferredShading --inflate-benchmark <png>...
+	//       DeferredShading --qoi-benchmark <png>
+	//       DeferredShading --qoi-to-png <qoi>...
+	//       DeferredShading [--uncompressed-textures] [--bake-texture <image>]... [--bake-normal-map <image>]...
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--headless") == 0)
+		{
+			//the frame count is optional: a following flag is left for the next iteration
+			int frames = (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) ? atoi(argv[++i]) : 300;
+			wm.SetHeadless(frames > 0 ? frames : 300);
+		}
+		else if (strcmp(argv[i], "--serial-obj") == 0)
+		{
+			wm.SetParallelObjLoading(false);
+		}
+		else if (strcmp(argv[i], "--no-mesh-optimization") == 0)
+		{
+			wm.SetMeshOptimization(false);
+		}
+		else if (strcmp(argv[i], "--vertex-layout") == 0 && i + 1 < argc)
+		{
+			i++;
+			if (strcmp(argv[i], "packed") == 0)
+				wm.SetVertexLayout(VERTEX_LAYOUT_PACKED);
+			else if (strcmp(argv[i], "packed16") == 0)
+				wm.SetVertexLayout(VERTEX_LAYOUT_PACKED16);
+			else
+				wm.SetVertexLayout(VERTEX_LAYOUT_FLOAT);
+		}
+		else if (strcmp(argv[i], "--gbuffer") == 0 && i + 1 < argc)
+		{
+			i++;
+			wm.SetCompactGBuffer(strcmp(argv[i], "compact") == 0);
+		}
+		else if (strcmp(argv[i], "--tiled-lights") == 0 && i + 1 < argc)
+		{
+			int lights = atoi(argv[++i]);
+			wm.SetTiledLighting(lights > 0 ? lights : 1024);
+		}
+		else if (strcmp(argv[i], "--clustered-lights") == 0 && i + 1 < argc)
+		{
+			int lights = atoi(argv[++i]);
+			wm.SetClusteredLighting(lights > 0 ? lights : 1024);
+		}
+		else if (strcmp(argv[i], "--light-volumes") == 0 && i + 1 < argc)
+		{
+			int lights = atoi(argv[++i]);
+			wm.SetLightVolumes(lights > 0 ? lights : 1024);
+		}
+		else if (strcmp(argv[i], "--animate-lights") == 0)
+		{
+			wm.SetAnimatedLights(true);
+		}
+		else if (strcmp(argv[i], "--no-program-cache") == 0)
+		{
+			wm.SetProgramCache(false);
+		}
+		else if (strcmp(argv[i], "--generic-shaders") == 0)
+		{
+			wm.SetSpecializedShaders(false);
+		}
+		else if (strcmp(argv[i], "--uncompressed-textures") == 0)
+		{
+			wm.SetTextureCompression(false);
+		}
+		else if (strcmp(argv[i], "--capture-every") == 0 && i + 1 < argc)
+		{
+			int frames = atoi(argv[++i]);
+			wm.SetCaptureInterval(frames > 0 ? frames : 1);
+		}
+		else if (strcmp(argv[i], "--capture-format") == 0 && i + 1 < argc)
+		{
+			i++;
+			wm.SetQoiCaptures(strcmp(argv[i], "qoi") == 0);
+		}
+	}
 	
 	
 	wm.LoadModel("golfball/golfball.obj", false);
@@ -16,4 +226,4 @@ int main()
 	
 	wm.InitializeSceneInfo();
 	wm.StartRenderLoop();
-}
\ No newline at end of file
+}